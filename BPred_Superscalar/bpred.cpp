@@ -1,21 +1,122 @@
 #include "bpred.h"
+#include "bpred_impl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define TAKEN   true
 #define NOTTAKEN false
 
+/////////////////////////////////////////////////////////////
+// Configuration
+/////////////////////////////////////////////////////////////
+
+void bpred_config_init(BPRED_Config *cfg){
+  cfg->table_bits    = 12;
+  cfg->hist_len      = 12;
+  cfg->ctr_bits      = 2;
+  cfg->tage_tables   = 4;
+  cfg->tage_bits     = 10;
+  cfg->tage_tag_bits = 9;
+  cfg->tage_min_hist = 4;
+  cfg->tage_max_hist = 64;
+}
+
+bool bpred_config_check(uint32_t policy, const BPRED_Config *cfg, const char **why){
+  const char *err = NULL;
+  if(policy >= NUM_BPRED_TYPE){
+    err = "unknown branch predictor policy";
+  } else if(cfg->table_bits < 1 || cfg->table_bits > 28){
+    err = "table bits must be 1..28";
+  } else if(cfg->hist_len > 64){
+    err = "history length must be at most 64";
+  } else if(cfg->ctr_bits < 1 || cfg->ctr_bits > 8){
+    err = "counter bits must be 1..8";
+  } else if(policy == BPRED_TAGE
+            && (cfg->tage_tables < 1 || cfg->tage_tables > 16
+                || cfg->tage_bits < 1 || cfg->tage_bits > 24
+                || cfg->tage_tag_bits < 1 || cfg->tage_tag_bits > 10
+                || cfg->tage_min_hist < 1 || cfg->tage_min_hist > cfg->tage_max_hist
+                || cfg->tage_max_hist > 64)){
+    err = "bad TAGE geometry";
+  }
+
+  if(why){
+    *why = err;
+  }
+  return err == NULL;
+}
+
+bool bpred_config_arg(BPRED_Config *cfg, const char *opt, const char *value){
+  uint32_t *field = NULL;
+  if(!strcmp(opt, "-bpredbits"))        field = &cfg->table_bits;
+  else if(!strcmp(opt, "-bpredhist"))   field = &cfg->hist_len;
+  else if(!strcmp(opt, "-bpredctr"))    field = &cfg->ctr_bits;
+  else if(!strcmp(opt, "-tagetables"))  field = &cfg->tage_tables;
+  else if(!strcmp(opt, "-tagebits"))    field = &cfg->tage_bits;
+  else if(!strcmp(opt, "-tagetagbits")) field = &cfg->tage_tag_bits;
+  else if(!strcmp(opt, "-tagehist"))    field = &cfg->tage_max_hist;
+
+  if(field == NULL){
+    return false;
+  }
+  *field = atoi(value);
+  return true;
+}
+
+void bpred_config_usage(void){
+    printf("   -bpredbits   <num>    log2 entries of the predictor table (Default: 12)\n");
+    printf("   -bpredhist   <num>    Global history bits, up to 64 (Default: 12)\n");
+    printf("   -bpredctr    <num>    Saturating counter bits (Default: 2)\n");
+    printf("   -tagetables  <num>    TAGE tagged tables (Default: 4)\n");
+    printf("   -tagebits    <num>    log2 entries per TAGE tagged table (Default: 10)\n");
+    printf("   -tagetagbits <num>    TAGE tag bits, up to 10 (Default: 9)\n");
+    printf("   -tagehist    <num>    Longest TAGE history, up to 64 (Default: 64)\n");
+}
+
 /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////
 
-BPRED::BPRED(uint32_t policy) {
+static BPRED_Config bpred_default_config(){
+  BPRED_Config cfg;
+  bpred_config_init(&cfg);
+  return cfg;
+}
+
+BPRED::BPRED(uint32_t policy) : BPRED(policy, bpred_default_config()) {
+}
+
+BPRED::BPRED(uint32_t policy, const BPRED_Config &cfg) {
+  this->policy = (BPRED_TYPE) policy;
+  impl = NULL;
+  ghr = 0;
+  stat_num_branches = 0;
+  stat_num_mispred = 0;
+
+  switch(policy){
+    case BPRED_GSHARE:      impl = bpred_new_gshare(cfg);      break;
+    case BPRED_BIMODAL:     impl = bpred_new_bimodal(cfg);     break;
+    case BPRED_TOURNAMENT:  impl = bpred_new_tournament(cfg);  break;
+    case BPRED_TAGE:        impl = bpred_new_tage(cfg);        break;
+    case BPRED_PERCEPTRON:  impl = bpred_new_perceptron(cfg);  break;
+    default:                                                   break;
+  }
+}
 
-  
+BPRED::~BPRED() {
+  delete impl;
 }
 
 /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////
 
 bool BPRED::GetPrediction(uint32_t PC){
-    return TAKEN;  
+    // BPRED_PERFECT never builds a BPRED, the pipeline skips prediction
+    if(impl == NULL){
+      return TAKEN;
+    }
+    return impl->Predict(PC, ghr);
 }
 
 
@@ -23,10 +124,128 @@ bool BPRED::GetPrediction(uint32_t PC){
 /////////////////////////////////////////////////////////////
 
 void  BPRED::UpdatePredictor(uint32_t PC, bool resolveDir, bool predDir) {
+    if(impl == NULL){
+      return;
+    }
+    impl->Update(PC, ghr, resolveDir, predDir);
+    ghr = (ghr << 1) | (resolveDir ? 1 : 0);
+}
+
+/////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////
+
+bool BPRED::PredictSpeculative(uint32_t PC, uint64_t *checkpoint) {
+    bool predDir = GetPrediction(PC);
+    *checkpoint = ghr;
+    ghr = (ghr << 1) | (predDir ? 1 : 0);
+    return predDir;
+}
 
+void BPRED::Repair(uint64_t checkpoint, bool resolveDir) {
+    ghr = (checkpoint << 1) | (resolveDir ? 1 : 0);
+}
+
+void BPRED::Train(uint32_t PC, uint64_t checkpoint, bool resolveDir, bool predDir) {
+    if(impl == NULL){
+      return;
+    }
+    impl->Update(PC, checkpoint, resolveDir, predDir);
+}
 
+size_t BPRED::StorageBytes() const {
+    return impl ? impl->Bytes() : 0;
 }
 
 /////////////////////////////////////////////////////////////
+// Bimodal: a table of saturating counters indexed by PC
+/////////////////////////////////////////////////////////////
+
+class BPRED_Bimodal : public BPRED_Impl {
+public:
+  BPRED_Bimodal(const BPRED_Config &cfg) : pht(cfg.table_bits, cfg.ctr_bits) { }
+
+  bool Predict(uint32_t PC, uint64_t /*ghr*/) {
+    return pht.Predict(PC);
+  }
+  void Update(uint32_t PC, uint64_t /*ghr*/, bool resolveDir, bool /*predDir*/) {
+    pht.Update(PC, resolveDir);
+  }
+  size_t Bytes() const {
+    return pht.Bytes();
+  }
+
+private:
+  BPRED_Counters pht;
+};
+
+/////////////////////////////////////////////////////////////
+// Gshare: counters indexed by PC xor global history
+/////////////////////////////////////////////////////////////
+
+class BPRED_Gshare : public BPRED_Impl {
+public:
+  BPRED_Gshare(const BPRED_Config &cfg)
+    : hist_mask(HistMask(cfg.hist_len)), pht(cfg.table_bits, cfg.ctr_bits) { }
+
+  bool Predict(uint32_t PC, uint64_t ghr) {
+    return pht.Predict(PC ^ (ghr & hist_mask));
+  }
+  void Update(uint32_t PC, uint64_t ghr, bool resolveDir, bool /*predDir*/) {
+    pht.Update(PC ^ (ghr & hist_mask), resolveDir);
+  }
+  size_t Bytes() const {
+    return pht.Bytes();
+  }
+
+private:
+  uint64_t hist_mask;
+  BPRED_Counters pht;
+};
+
+/////////////////////////////////////////////////////////////
+// Tournament: bimodal and gshare, with a per-PC chooser that
+// moves toward whichever was right when they disagree
 /////////////////////////////////////////////////////////////
 
+class BPRED_Tournament : public BPRED_Impl {
+public:
+  BPRED_Tournament(const BPRED_Config &cfg)
+    : bimodal(cfg), gshare(cfg), chooser(cfg.table_bits, 2) { }
+
+  bool Predict(uint32_t PC, uint64_t ghr) {
+    // chooser taken means trust gshare
+    return chooser.Predict(PC) ? gshare.Predict(PC, ghr) : bimodal.Predict(PC, ghr);
+  }
+  void Update(uint32_t PC, uint64_t ghr, bool resolveDir, bool /*predDir*/) {
+    bool bimodal_dir = bimodal.Predict(PC, ghr);
+    bool gshare_dir = gshare.Predict(PC, ghr);
+    if(bimodal_dir != gshare_dir){
+      chooser.Update(PC, gshare_dir == resolveDir);
+    }
+    bimodal.Update(PC, ghr, resolveDir, bimodal_dir);
+    gshare.Update(PC, ghr, resolveDir, gshare_dir);
+  }
+  size_t Bytes() const {
+    return bimodal.Bytes() + gshare.Bytes() + chooser.Bytes();
+  }
+
+private:
+  BPRED_Bimodal bimodal;
+  BPRED_Gshare gshare;
+  BPRED_Counters chooser;
+};
+
+/////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////
+
+BPRED_Impl* bpred_new_bimodal(const BPRED_Config &cfg){
+  return new BPRED_Bimodal(cfg);
+}
+
+BPRED_Impl* bpred_new_gshare(const BPRED_Config &cfg){
+  return new BPRED_Gshare(cfg);
+}
+
+BPRED_Impl* bpred_new_tournament(const BPRED_Config &cfg){
+  return new BPRED_Tournament(cfg);
+}
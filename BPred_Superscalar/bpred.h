@@ -1,6 +1,7 @@
 #ifndef _BPRED_H_
 #define _BPRED_H_
 #include <inttypes.h>
+#include <stddef.h>
 
 
 
@@ -22,14 +23,39 @@ typedef enum BPRED_TYPE_ENUM {
     BPRED_PERFECT=0,
     BPRED_ALWAYS_TAKEN=1,
     BPRED_GSHARE=2, 
-    NUM_BPRED_TYPE=3
+    BPRED_BIMODAL=3,
+    BPRED_TOURNAMENT=4,
+    BPRED_TAGE=5,
+    BPRED_PERCEPTRON=6,
+    NUM_BPRED_TYPE=7
 } BPRED_TYPE;
 
+/* Predictor sizing. Not every field applies to every policy. */
+typedef struct BPRED_Config_Struct {
+  uint32_t table_bits;      // log2 entries: PHT, TAGE base table, perceptrons
+  uint32_t hist_len;        // global history bits (<= 64)
+  uint32_t ctr_bits;        // saturating counter width
+  uint32_t tage_tables;     // TAGE tagged tables
+  uint32_t tage_bits;       // log2 entries per tagged table
+  uint32_t tage_tag_bits;   // tag width
+  uint32_t tage_min_hist;   // history lengths grow geometrically
+  uint32_t tage_max_hist;   //   from min to max (<= 64)
+} BPRED_Config;
+
+void bpred_config_init(BPRED_Config *cfg);                     // defaults
+bool bpred_config_check(uint32_t policy, const BPRED_Config *cfg, const char **why);
+bool bpred_config_arg(BPRED_Config *cfg, const char *opt, const char *value);  // false if not a sizing option
+void bpred_config_usage(void);                                 // print the sizing options
+
+class BPRED_Impl;
+
 /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////
 
 class BPRED{
   BPRED_TYPE policy;
+  BPRED_Impl *impl;         // the predictor proper, NULL for the fixed policies
+  uint64_t ghr;             // global history, newest outcome in bit 0
 
 public:
   uint64_t stat_num_branches;
@@ -39,6 +65,18 @@ public:
     BPRED(uint32_t policy);
     bool GetPrediction(uint32_t PC);  
     void UpdatePredictor(uint32_t PC, bool resolveDir, bool predDir);
+
+    BPRED(uint32_t policy, const BPRED_Config &cfg);
+    ~BPRED();
+    size_t StorageBytes() const;        // host memory used by the tables
+
+// Pipelined use. A branch is predicted at fetch with the speculative
+// history, which takes the predicted direction right away, and keeps
+// the history it saw as its checkpoint. When it resolves it trains
+// with that checkpoint, and a mispredict rebuilds the history from it.
+    bool PredictSpeculative(uint32_t PC, uint64_t *checkpoint);
+    void Repair(uint64_t checkpoint, bool resolveDir);
+    void Train(uint32_t PC, uint64_t checkpoint, bool resolveDir, bool predDir);
 };
 
 /***********************************************************/
@@ -0,0 +1,523 @@
+/********************************************************************
+ * File         : bpred_eval.cpp
+ * Description  : Branch-only predictor replay, no pipeline
+ *********************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+
+#include "bpred.h"
+#include "bpred_sweep.h"
+#include "trace_reader.h"
+#include "trace_branch.h"
+
+#define EVAL_BATCH 8192          // branches gathered per call from a full trace
+
+
+/*********************************************************************
+ * Global Scope Functions
+ *********************************************************************/
+
+void die_message(const char *msg) {
+    printf("Error! %s. Exiting...\n", msg);
+    exit(1);
+}
+
+void die_usage() {
+    printf("Usage : bpred_eval [options] <trace_file> \n\n");
+    printf("Replays only the conditional branches of a trace through BPRED\n");
+    printf("<trace_file> is a branch trace (trace_convert -branch) or any trace sim reads\n");
+    printf("Options\n");
+    printf("   -bpredpolicy <num>    Set branch predictor  [0:Perf 1:Taken 2:Gshare 3:Bimodal\n");
+    printf("                                                 4:Tournament 5:TAGE 6:Perceptron]\n");
+    bpred_config_usage();
+    printf("   -top         <num>    Report the <num> worst branch PCs (Default: 10)\n");
+    printf("   -sweep                Run every gshare point below in one pass instead\n");
+    printf("   -sweepbits   <range>  log2 table entries, lo[:hi[:step]] (Default: 10:16:2)\n");
+    printf("   -sweephist   <range>  History bits, 0 is bimodal (Default: 0:16:4)\n");
+    printf("   -sweepctr    <range>  Counter bits (Default: 1:3)\n");
+    printf("   -csv         <file>   Write the sweep as CSV, - for stdout (Default: none)\n");
+    printf("   -bench       <range>  Time the predictor at each table size in lo[:hi[:step]]\n");
+    printf("                         (log2 entries, per tagged table for TAGE), with host\n");
+    printf("                         cache misses per branch where the kernel reports them\n");
+    exit(0);
+}
+
+
+/*********************************************************************
+ * Per-PC stats, open addressing keyed by PC
+ *********************************************************************/
+
+typedef struct Eval_PC_Struct {
+  uint32_t pc;
+  uint32_t used;
+  uint64_t count;
+  uint64_t mispred;
+} Eval_PC;
+
+typedef struct Eval_PC_Table_Struct {
+  Eval_PC *slot;
+  uint64_t mask;
+  uint64_t used;
+} Eval_PC_Table;
+
+static inline uint64_t eval_pc_hash(uint32_t pc){
+    return (pc * 0x9E3779B97F4A7C15ull) >> 20;
+}
+
+static void eval_pc_init(Eval_PC_Table *t, uint64_t slots){
+    t->slot = (Eval_PC *) calloc (slots, sizeof (Eval_PC));
+    t->mask = slots - 1;
+    t->used = 0;
+}
+
+static Eval_PC* eval_pc_find(Eval_PC_Table *t, uint32_t pc);
+
+static void eval_pc_grow(Eval_PC_Table *t){
+    Eval_PC_Table old = *t;
+    eval_pc_init(t, 2 * (old.mask + 1));
+    for(uint64_t ii = 0; ii <= old.mask; ii++) {
+      if(old.slot[ii].used) {
+        *eval_pc_find(t, old.slot[ii].pc) = old.slot[ii];
+      }
+    }
+    free(old.slot);
+}
+
+static Eval_PC* eval_pc_find(Eval_PC_Table *t, uint32_t pc){
+    uint64_t ii = eval_pc_hash(pc) & t->mask;
+    while(t->slot[ii].used && t->slot[ii].pc != pc) {
+      ii = (ii + 1) & t->mask;
+    }
+    if(!t->slot[ii].used) {
+      // keep the load under one half so probes stay short
+      if(2 * (t->used + 1) > t->mask + 1) {
+        eval_pc_grow(t);
+        return eval_pc_find(t, pc);
+      }
+      t->slot[ii].used = 1;
+      t->slot[ii].pc = pc;
+      t->used++;
+    }
+    return &t->slot[ii];
+}
+
+static bool eval_pc_worse(const Eval_PC &a, const Eval_PC &b){
+    if(a.mispred != b.mispred) {
+      return a.mispred > b.mispred;
+    }
+    return a.pc < b.pc;
+}
+
+
+/*********************************************************************
+ * Host cache counters, from perf_event_open. Not every machine (or
+ * VM) exposes them; a counter that cannot be opened reads as n/a.
+ *********************************************************************/
+
+#define HOST_NUM_COUNTERS 2      // L1D read misses, last level misses
+
+typedef struct Host_Counters_Struct {
+  int      fd[HOST_NUM_COUNTERS];
+  uint64_t val[HOST_NUM_COUNTERS];
+} Host_Counters;
+
+static int host_counter_open(uint32_t type, uint64_t config){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void host_counters_open(Host_Counters *hc){
+    hc->fd[0] = host_counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    hc->fd[1] = host_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+
+static void host_counters_close(Host_Counters *hc){
+    for(int ii = 0; ii < HOST_NUM_COUNTERS; ii++) {
+      if(hc->fd[ii] >= 0) {
+        close(hc->fd[ii]);
+      }
+    }
+}
+
+static void host_counters_start(Host_Counters *hc){
+    for(int ii = 0; ii < HOST_NUM_COUNTERS; ii++) {
+      if(hc->fd[ii] >= 0) {
+        ioctl(hc->fd[ii], PERF_EVENT_IOC_RESET, 0);
+        ioctl(hc->fd[ii], PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+}
+
+static void host_counters_stop(Host_Counters *hc){
+    for(int ii = 0; ii < HOST_NUM_COUNTERS; ii++) {
+      hc->val[ii] = 0;
+      if(hc->fd[ii] >= 0) {
+        ioctl(hc->fd[ii], PERF_EVENT_IOC_DISABLE, 0);
+        if(read(hc->fd[ii], &hc->val[ii], sizeof(uint64_t)) != sizeof(uint64_t)) {
+          hc->val[ii] = 0;
+        }
+      }
+    }
+}
+
+// misses per branch, or n/a
+static void host_counter_print(const Host_Counters *hc, int ii, uint64_t num_branches){
+    if(hc->fd[ii] < 0 || num_branches == 0) {
+      printf(" %10s", "n/a");
+    } else {
+      printf(" %10.4f", (double) hc->val[ii] / num_branches);
+    }
+}
+
+
+/*********************************************************************
+ * Params and Globals
+ *********************************************************************/
+uint32_t  BPRED_POLICY=0; // 0:Perf 1:AlwaysTaken 2:Gshare 3:Bimodal 4:Tournament 5:TAGE 6:Perceptron
+BPRED_Config BPRED_CONFIG;
+uint32_t  TOP_PCS=10;
+uint32_t  SWEEP=0;
+BPRED_Sweep_Range SWEEP_BITS = {10, 16, 2};
+BPRED_Sweep_Range SWEEP_HIST = {0, 16, 4};
+BPRED_Sweep_Range SWEEP_CTR  = {1, 3, 1};
+char     *CSV_FILE=NULL;
+uint32_t  BENCH=0;
+BPRED_Sweep_Range BENCH_BITS;
+
+BPRED        *b_pred;
+BPRED_Sweep   sweep;
+Trace_Branch_Rec *bench_recs;    // -bench replays from memory
+uint64_t      bench_num, bench_cap;
+Eval_PC_Table pc_stats;
+
+/*********************************************************************
+ * Replay one run of branches. BPRED_PERFECT never mispredicts and
+ * needs no BPRED, same as in the pipeline.
+ *********************************************************************/
+
+static void eval_predict(const Trace_Branch_Rec *recs, uint64_t n){
+    for(uint64_t ii = 0; ii < n; ii++) {
+      uint32_t pc = recs[ii].pc;
+      bool dir = recs[ii].dir;
+      bool pred_dir = dir;
+
+      if(b_pred) {
+        b_pred->stat_num_branches++;
+        pred_dir = b_pred->GetPrediction(pc);
+        b_pred->UpdatePredictor(pc, dir, pred_dir);
+        b_pred->stat_num_mispred += (pred_dir != dir);
+      }
+      if(TOP_PCS) {
+        Eval_PC *e = eval_pc_find(&pc_stats, pc);
+        e->count++;
+        e->mispred += (pred_dir != dir);
+      }
+    }
+}
+
+// hand branches to the sweep, the bench buffer or the predictor
+static void eval_branches(const Trace_Branch_Rec *recs, uint64_t n){
+    if(BENCH) {
+      if(bench_num + n > bench_cap) {
+        bench_cap = std::max(2 * bench_cap, bench_num + n);
+        bench_recs = (Trace_Branch_Rec *) realloc (bench_recs, bench_cap * sizeof (Trace_Branch_Rec));
+      }
+      memcpy(bench_recs + bench_num, recs, n * sizeof (Trace_Branch_Rec));
+      bench_num += n;
+    } else if(SWEEP) {
+      bpred_sweep_run(&sweep, recs, n);
+    } else {
+      eval_predict(recs, n);
+    }
+}
+
+// pull the OP_CBR records out of a full trace in batches
+static void eval_trace(Trace_Reader *tr, uint64_t *num_insts, uint64_t *num_branches){
+    static Trace_Branch_Rec batch[EVAL_BATCH];
+    const Trace_Rec *rec;
+    uint64_t n = 0;
+
+    *num_insts = 0;
+    *num_branches = 0;
+
+    while((rec = trace_next(tr)) != NULL) {
+      (*num_insts)++;
+      if(rec->op_type != OP_CBR) {
+        continue;
+      }
+      batch[n].pc = rec->inst_addr;
+      batch[n].dir = rec->br_dir;
+      (*num_branches)++;
+      if(++n == EVAL_BATCH) {
+        eval_branches(batch, n);
+        n = 0;
+      }
+    }
+    eval_branches(batch, n);
+}
+
+/*********************************************************************
+ * Benchmark: the same branches through each table size, timing the
+ * replay and counting host cache misses around it
+ *********************************************************************/
+
+static void run_bench(const Trace_Branch_Rec *recs, uint64_t n, uint64_t num_insts){
+    Host_Counters hc;
+    host_counters_open(&hc);
+
+    printf("\n%6s %12s %10s %10s %10s %10s %10s\n", "bits", "storage_KB", "Mbr/s",
+           "ns/br", "L1D_mr/br", "LLC_m/br", "MPKI");
+    for (uint32_t bits = BENCH_BITS.lo; bits <= BENCH_BITS.hi; bits += BENCH_BITS.step) {
+        BPRED_Config cfg = BPRED_CONFIG;
+        const char *why;
+        if (BPRED_POLICY == BPRED_TAGE) {
+            cfg.tage_bits = bits;
+        } else {
+            cfg.table_bits = bits;
+        }
+        if (!bpred_config_check(BPRED_POLICY, &cfg, &why)) {
+            die_message(why);
+        }
+
+        struct timespec t0, t1;
+        b_pred = new BPRED(BPRED_POLICY, cfg);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        host_counters_start(&hc);
+        eval_predict(recs, n);
+        host_counters_stop(&hc);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+        printf("%6u %12.1f %10.1f %10.2f", bits, b_pred->StorageBytes() / 1024.0,
+               secs > 0 ? n / secs / 1e6 : 0, n ? 1e9 * secs / n : 0);
+        host_counter_print(&hc, 0, n);
+        host_counter_print(&hc, 1, n);
+        printf(" %10.3f\n", num_insts ? 1000.0 * b_pred->stat_num_mispred / num_insts : 0);
+
+        delete b_pred;
+        b_pred = NULL;
+    }
+    host_counters_close(&hc);
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char *argv[])
+{
+  int ii;
+
+    char tr_filename[1024] = "-";
+
+    bpred_config_init(&BPRED_CONFIG);
+
+    for ( ii = 1; ii < argc; ii++) {
+	if (argv[ii][0] == '-' && argv[ii][1]) {
+	    if (!strcmp(argv[ii], "-h") || !strcmp(argv[ii], "-help")) {
+		die_usage();
+	    }
+
+	    else if (!strcmp(argv[ii], "-bpredpolicy")) {
+		if (ii < argc - 1) {
+		    BPRED_POLICY = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (ii < argc - 1 && bpred_config_arg(&BPRED_CONFIG, argv[ii], argv[ii+1])) {
+		ii += 1;
+	    }
+
+	    else if (!strcmp(argv[ii], "-top")) {
+		if (ii < argc - 1) {
+		    TOP_PCS = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-sweep")) {
+	      SWEEP = 1;
+	    }
+
+	    else if (!strcmp(argv[ii], "-sweepbits") || !strcmp(argv[ii], "-sweephist")
+		     || !strcmp(argv[ii], "-sweepctr")) {
+		if (ii < argc - 1) {
+		    BPRED_Sweep_Range *r = !strcmp(argv[ii], "-sweepbits") ? &SWEEP_BITS
+		                         : !strcmp(argv[ii], "-sweephist") ? &SWEEP_HIST : &SWEEP_CTR;
+		    if (!bpred_sweep_range(argv[ii+1], r)) {
+			die_message("Sweep ranges are lo[:hi[:step]]");
+		    }
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-bench")) {
+		if (ii < argc - 1) {
+		    if (!bpred_sweep_range(argv[ii+1], &BENCH_BITS)) {
+			die_message("Bench ranges are lo[:hi[:step]]");
+		    }
+		    BENCH = 1;
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-csv")) {
+		if (ii < argc - 1) {
+		    CSV_FILE = argv[ii+1];
+		    ii += 1;
+		}
+	    }
+	}
+	else {
+	  strcpy(tr_filename, argv[ii]);
+	}
+    }
+
+    const char *bpred_why;
+    if (!bpred_config_check(BPRED_POLICY, &BPRED_CONFIG, &bpred_why)) {
+        die_message(bpred_why);
+    }
+
+    if (BENCH) {
+        if (SWEEP || BPRED_POLICY < BPRED_GSHARE) {
+            die_message("-bench needs a table-based -bpredpolicy and no -sweep");
+        }
+        TOP_PCS = 0;
+    } else if (SWEEP) {
+        if (!bpred_sweep_init(&sweep, &SWEEP_BITS, &SWEEP_HIST, &SWEEP_CTR, &bpred_why)) {
+            die_message(bpred_why);
+        }
+        TOP_PCS = 0;
+    } else if (BPRED_POLICY != BPRED_PERFECT) {
+        b_pred = new BPRED(BPRED_POLICY, BPRED_CONFIG);
+    }
+    eval_pc_init(&pc_stats, 1 << 12);
+
+    //--------------------------------------------------------------------
+    // -- Replay: a branch trace in place, anything else filtered
+    //--------------------------------------------------------------------
+    struct timespec t0, t1;
+    uint64_t num_insts, num_branches;
+    bool bad = false;
+
+    Trace_Branches *tb = NULL;
+    if (strcmp(tr_filename, "-")) {
+        tb = trace_branches_open(tr_filename, &bad);
+    }
+    if (bad) {
+        die_message("Unable to use the branch trace");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (tb) {
+        eval_branches(tb->recs, tb->num_recs);
+        num_insts = tb->num_insts;
+        num_branches = tb->num_recs;
+        trace_branches_close(tb);
+    } else {
+        Trace_Reader *tr_reader = trace_open(tr_filename);
+        if (tr_reader == NULL) {
+            die_message("Unable to open the trace file");
+        }
+        eval_trace(tr_reader, &num_insts, &num_branches);
+        trace_close(tr_reader);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+    if (BENCH) {
+        printf("\nEVAL_NUM_INST           \t : %10llu", (unsigned long long) num_insts);
+        printf("\nEVAL_NUM_BRANCHES       \t : %10llu", (unsigned long long) num_branches);
+        printf("\n");
+        run_bench(bench_recs, bench_num, num_insts);
+        free(bench_recs);
+        return 0;
+    }
+
+    //--------------------------------------------------------------------
+    // -- Report
+    //--------------------------------------------------------------------
+    if (SWEEP) {
+        printf("\nEVAL_NUM_INST           \t : %10llu", (unsigned long long) num_insts);
+        printf("\nEVAL_NUM_BRANCHES       \t : %10llu", (unsigned long long) num_branches);
+        printf("\nEVAL_SWEEP_CONFIGS      \t : %10u", bpred_sweep_configs(&sweep));
+        printf("\nEVAL_SECONDS            \t : %10.3f", secs);
+        printf("\nEVAL_MBRANCHES_PER_SEC  \t : %10.1f", secs > 0 ? num_branches / secs / 1e6 : 0);
+        printf("\n");
+        bpred_sweep_heatmap(&sweep, num_insts, stdout);
+
+        if (CSV_FILE) {
+            FILE *csv = strcmp(CSV_FILE, "-") ? fopen(CSV_FILE, "w") : stdout;
+            if (csv == NULL) {
+                die_message("Unable to write the CSV file");
+            }
+            if (csv == stdout) {
+                printf("\n");
+            }
+            bpred_sweep_csv(&sweep, num_insts, csv);
+            if (csv != stdout) {
+                fclose(csv);
+            }
+        }
+        bpred_sweep_free(&sweep);
+        return 0;
+    }
+
+    uint64_t mispred = b_pred ? b_pred->stat_num_mispred : 0;
+    double rate = num_branches ? 100.0 * mispred / num_branches : 0;
+    double mpki = num_insts ? 1000.0 * mispred / num_insts : 0;
+
+    printf("\nEVAL_NUM_INST           \t : %10llu", (unsigned long long) num_insts);
+    printf("\nEVAL_NUM_BRANCHES       \t : %10llu", (unsigned long long) num_branches);
+    printf("\nEVAL_NUM_MISPRED        \t : %10llu", (unsigned long long) mispred);
+    printf("\nEVAL_MISPRED_RATE       \t : %10.3f", rate);
+    printf("\nEVAL_MPKI               \t : %10.3f", mpki);
+    if (TOP_PCS) {     // per-PC stats are only kept for the top list
+        printf("\nEVAL_STATIC_BRANCHES    \t : %10llu", (unsigned long long) pc_stats.used);
+    }
+    printf("\nEVAL_SECONDS            \t : %10.3f", secs);
+    printf("\nEVAL_MBRANCHES_PER_SEC  \t : %10.1f", secs > 0 ? num_branches / secs / 1e6 : 0);
+    printf("\n");
+
+    if (TOP_PCS && mispred) {
+        Eval_PC *all = (Eval_PC *) malloc (pc_stats.used * sizeof (Eval_PC));
+        uint64_t n = 0;
+        for (uint64_t jj = 0; jj <= pc_stats.mask; jj++) {
+            if (pc_stats.slot[jj].used) {
+                all[n++] = pc_stats.slot[jj];
+            }
+        }
+        uint64_t top = std::min<uint64_t>(TOP_PCS, n);
+        std::partial_sort(all, all + top, all + n, eval_pc_worse);
+
+        printf("\n%-10s %12s %12s %8s %8s\n", "pc", "branches", "mispred", "rate%", "share%");
+        for (uint64_t jj = 0; jj < top && all[jj].mispred; jj++) {
+            printf("0x%08x %12llu %12llu %8.2f %8.2f\n", all[jj].pc,
+                   (unsigned long long) all[jj].count, (unsigned long long) all[jj].mispred,
+                   100.0 * all[jj].mispred / all[jj].count, 100.0 * all[jj].mispred / mispred);
+        }
+        free(all);
+    }
+
+    delete b_pred;
+    free(pc_stats.slot);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#ifndef _BPRED_IMPL_H_
+#define _BPRED_IMPL_H_
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+
+#include "bpred.h"
+
+/////////////////////////////////////////////////////////////
+// Predictor implementations behind BPRED. BPRED owns the global
+// history and passes the value it had at prediction time to both
+// calls, so an implementation can recompute its lookup on update
+// instead of remembering it.
+/////////////////////////////////////////////////////////////
+
+class BPRED_Impl {
+public:
+  virtual ~BPRED_Impl() {}
+  virtual bool Predict(uint32_t PC, uint64_t ghr) = 0;
+  virtual void Update(uint32_t PC, uint64_t ghr, bool resolveDir, bool predDir) = 0;
+  virtual size_t Bytes() const = 0;          // host memory held by the tables
+};
+
+BPRED_Impl* bpred_new_bimodal(const BPRED_Config &cfg);
+BPRED_Impl* bpred_new_gshare(const BPRED_Config &cfg);
+BPRED_Impl* bpred_new_tournament(const BPRED_Config &cfg);
+BPRED_Impl* bpred_new_tage(const BPRED_Config &cfg);
+BPRED_Impl* bpred_new_perceptron(const BPRED_Config &cfg);
+
+static inline uint64_t HistMask(uint32_t bits)
+{
+    return (bits >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << bits) - 1);
+}
+
+/////////////////////////////////////////////////////////////
+// A table of ctr_bits saturating counters, starting weakly taken.
+// Counters are bit-packed into 64-bit words, each in a slot of
+// 1, 2, 4 or 8 bits (ctr_bits rounded up to a power of two so no
+// counter straddles a word): a 1M-entry table of 2-bit counters
+// is 256KB instead of 1MB at a byte apiece.
+/////////////////////////////////////////////////////////////
+
+class BPRED_Counters {
+public:
+  BPRED_Counters(uint32_t index_bits, uint32_t ctr_bits)
+    : mask(HistMask(index_bits)), ctr_max((1u << ctr_bits) - 1),
+      taken_at(1u << (ctr_bits - 1)), slot_shift(SlotShift(ctr_bits)),
+      slot_mask(HistMask(1u << slot_shift)) {
+    // word_shift: log2 counters per word
+    word_shift = 6 - slot_shift;
+    uint64_t fill = 0;
+    for(uint32_t ii = 0; ii < (1u << word_shift); ii++)
+      fill |= (uint64_t)taken_at << (ii << slot_shift);
+    table.assign(((((size_t)1 << index_bits) - 1) >> word_shift) + 1, fill);
+  }
+
+  bool Predict(uint64_t index) const {
+    return Get(index & mask) >= taken_at;
+  }
+
+  void Update(uint64_t index, bool resolveDir) {
+    index &= mask;
+    uint32_t ctr = Get(index);
+    ctr = resolveDir ? SatIncrement(ctr, ctr_max) : SatDecrement(ctr);
+    uint32_t pos = (index & ((1u << word_shift) - 1)) << slot_shift;
+    uint64_t &word = table[index >> word_shift];
+    word = (word & ~(slot_mask << pos)) | ((uint64_t)ctr << pos);
+  }
+
+  size_t Bytes() const {
+    return table.size() * sizeof(uint64_t);
+  }
+
+private:
+  uint64_t mask;
+  uint32_t ctr_max;
+  uint32_t taken_at;
+  uint32_t slot_shift;              // log2 bits per slot
+  uint32_t word_shift;
+  uint64_t slot_mask;
+  std::vector<uint64_t> table;
+
+  static uint32_t SlotShift(uint32_t ctr_bits) {
+    uint32_t shift = 0;
+    while((1u << shift) < ctr_bits)
+      shift++;
+    return shift;
+  }
+
+  uint32_t Get(uint64_t index) const {
+    uint32_t pos = (index & ((1u << word_shift) - 1)) << slot_shift;
+    return (table[index >> word_shift] >> pos) & slot_mask;
+  }
+};
+
+#endif
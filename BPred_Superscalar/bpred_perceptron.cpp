@@ -0,0 +1,71 @@
+#include "bpred_impl.h"
+
+#include <vector>
+#include <stdlib.h>
+
+/////////////////////////////////////////////////////////////
+// Perceptron (Jimenez & Lin): one row of signed weights per PC
+// hash, one weight per history bit plus a bias. Predict taken if
+// the dot product with the history (as +1/-1) is non-negative;
+// train on a mispredict or when the output is below the
+// threshold.
+/////////////////////////////////////////////////////////////
+
+#define PERCEPTRON_W_MAX 127
+#define PERCEPTRON_W_MIN (-128)
+
+class BPRED_Perceptron : public BPRED_Impl {
+public:
+  BPRED_Perceptron(const BPRED_Config &cfg)
+    : hist_len(cfg.hist_len), row_mask(HistMask(cfg.table_bits)),
+      theta((int32_t)(1.93 * cfg.hist_len + 14)),
+      weights(((size_t)1 << cfg.table_bits) * (cfg.hist_len + 1), 0) { }
+
+  bool Predict(uint32_t PC, uint64_t ghr) {
+    return Output(PC, ghr) >= 0;
+  }
+
+  void Update(uint32_t PC, uint64_t ghr, bool resolveDir, bool /*predDir*/) {
+    int32_t y = Output(PC, ghr);
+    if((y >= 0) == resolveDir && abs(y) > theta)
+      return;
+
+    int8_t *w = Row(PC);
+    Train(&w[0], resolveDir);
+    for(uint32_t ii = 0; ii < hist_len; ii++)
+      Train(&w[ii + 1], ((ghr >> ii) & 1) == (uint64_t)resolveDir);
+  }
+
+  size_t Bytes() const {
+    return weights.size();
+  }
+
+private:
+  uint32_t hist_len;
+  uint64_t row_mask;
+  int32_t  theta;
+  std::vector<int8_t> weights;
+
+  int8_t* Row(uint32_t PC) {
+    return &weights[(PC & row_mask) * (hist_len + 1)];
+  }
+
+  int32_t Output(uint32_t PC, uint64_t ghr) {
+    const int8_t *w = Row(PC);
+    int32_t y = w[0];
+    for(uint32_t ii = 0; ii < hist_len; ii++)
+      y += ((ghr >> ii) & 1) ? w[ii + 1] : -w[ii + 1];
+    return y;
+  }
+
+  static void Train(int8_t *w, bool up) {
+    if(up && *w < PERCEPTRON_W_MAX)
+      (*w)++;
+    else if(!up && *w > PERCEPTRON_W_MIN)
+      (*w)--;
+  }
+};
+
+BPRED_Impl* bpred_new_perceptron(const BPRED_Config &cfg){
+  return new BPRED_Perceptron(cfg);
+}
@@ -0,0 +1,285 @@
+#include "bpred_sweep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SWEEP_MAX_BYTES  ((uint64_t)1 << 30)   // all groups' tables together
+#define SWEEP_BATCH      4096                  // branches per pass over the groups
+#define SWEEP_FLUSH      255                   // byte-lane mispredict counts fill up
+
+/////////////////////////////////////////////////////////////
+// Byte-lane helpers. Counters never exceed their lane's ctr_max
+// (<= 255), so adding or subtracting a 0/1 per lane never carries
+// into the next lane.
+/////////////////////////////////////////////////////////////
+
+static const uint64_t LANE_LOW7 = 0x7F7F7F7F7F7F7F7Full;
+static const uint64_t LANE_HIGH = 0x8080808080808080ull;
+
+// 1 in each byte of x that is not zero
+static inline uint64_t LaneNonZero(uint64_t x)
+{
+    return ((x | ((x & LANE_LOW7) + LANE_LOW7)) & LANE_HIGH) >> 7;
+}
+
+// SatIncrement in every lane: +1 where the counter is below its max
+static inline uint64_t LaneSatIncrement(uint64_t ctr, uint64_t max)
+{
+    return ctr + LaneNonZero(ctr ^ max);
+}
+
+// SatDecrement in every lane: -1 where the counter is above 0
+static inline uint64_t LaneSatDecrement(uint64_t ctr)
+{
+    return ctr - LaneNonZero(ctr);
+}
+
+/////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////
+
+bool bpred_sweep_range(const char *arg, BPRED_Sweep_Range *r){
+  char *end;
+  r->lo = strtoul(arg, &end, 10);
+  r->hi = r->lo;
+  r->step = 1;
+  if(end == arg){
+    return false;
+  }
+  if(*end == ':'){
+    arg = end + 1;
+    r->hi = strtoul(arg, &end, 10);
+    if(end == arg){
+      return false;
+    }
+  }
+  if(*end == ':'){
+    arg = end + 1;
+    r->step = strtoul(arg, &end, 10);
+    if(end == arg){
+      return false;
+    }
+  }
+  return *end == '\0' && r->step > 0 && r->lo <= r->hi;
+}
+
+bool bpred_sweep_init(BPRED_Sweep *s, const BPRED_Sweep_Range *bits,
+                      const BPRED_Sweep_Range *hist, const BPRED_Sweep_Range *ctr,
+                      const char **why){
+  memset(s, 0, sizeof(BPRED_Sweep));
+  *why = NULL;
+  if(bits->lo < 1 || bits->hi > 28){
+    *why = "sweep table bits must be 1..28";
+  } else if(ctr->lo < 1 || ctr->hi > 8){
+    *why = "sweep counter bits must be 1..8";
+  } else if(hist->lo > bits->hi){
+    *why = "sweep history is longer than every table";
+  }
+  if(*why){
+    return false;
+  }
+
+  // counter widths become byte lanes
+  for(uint32_t c = ctr->lo; c <= ctr->hi; c += ctr->step){
+    uint32_t shift = 8 * s->num_lanes;
+    s->ctr_bits[s->num_lanes++] = c;
+    s->lane_max   |= (uint64_t)((1u << c) - 1) << shift;
+    s->lane_taken |= (uint64_t)(1u << (c - 1)) << shift;
+    s->lane_one   |= (uint64_t)1 << shift;
+  }
+
+  uint64_t bytes = 0;
+  for(uint32_t b = bits->lo; b <= bits->hi; b += bits->step){
+    for(uint32_t h = hist->lo; h <= hist->hi && h <= b; h += hist->step){
+      bytes += sizeof(uint64_t) << b;
+      s->num_groups++;
+    }
+  }
+  if(bytes > SWEEP_MAX_BYTES){
+    *why = "sweep tables need more than 1GB";
+    return false;
+  }
+
+  uint32_t n = s->num_groups;
+  s->table_bits = (uint32_t *)  calloc (n, sizeof (uint32_t));
+  s->hist_len   = (uint32_t *)  calloc (n, sizeof (uint32_t));
+  s->hist_mask  = (uint32_t *)  calloc (n, sizeof (uint32_t));
+  s->table_mask = (uint32_t *)  calloc (n, sizeof (uint32_t));
+  s->tables     = (uint64_t **) calloc (n, sizeof (uint64_t *));
+  s->mispred    = (uint64_t *)  calloc (n * SWEEP_MAX_LANES, sizeof (uint64_t));
+
+  uint32_t g = 0;
+  for(uint32_t b = bits->lo; b <= bits->hi; b += bits->step){
+    for(uint32_t h = hist->lo; h <= hist->hi && h <= b; h += hist->step){
+      s->table_bits[g] = b;
+      s->hist_len[g]   = h;
+      s->hist_mask[g]  = (1u << h) - 1;
+      s->table_mask[g] = (1u << b) - 1;
+      s->tables[g]     = (uint64_t *) malloc (sizeof(uint64_t) << b);
+      for(uint64_t ii = 0; ii < ((uint64_t)1 << b); ii++){
+        s->tables[g][ii] = s->lane_taken;     // weakly taken
+      }
+      g++;
+    }
+  }
+  return true;
+}
+
+void bpred_sweep_free(BPRED_Sweep *s){
+  for(uint32_t g = 0; g < s->num_groups; g++){
+    free(s->tables[g]);
+  }
+  free(s->table_bits);
+  free(s->hist_len);
+  free(s->hist_mask);
+  free(s->table_mask);
+  free(s->tables);
+  free(s->mispred);
+  memset(s, 0, sizeof(BPRED_Sweep));
+}
+
+uint32_t bpred_sweep_configs(const BPRED_Sweep *s){
+  return s->num_groups * s->num_lanes;
+}
+
+/////////////////////////////////////////////////////////////
+// Kernel
+/////////////////////////////////////////////////////////////
+
+static void sweep_flush(BPRED_Sweep *s, uint32_t g, uint64_t acc){
+  for(uint32_t k = 0; k < SWEEP_MAX_LANES; k++){
+    s->mispred[g * SWEEP_MAX_LANES + k] += (acc >> (8 * k)) & 0xFF;
+  }
+}
+
+// one group over a batch; hist[i] is the global history before branch i
+static void sweep_group(BPRED_Sweep *s, uint32_t g, const uint32_t *pc,
+                        const uint32_t *hist, const uint8_t *dir, uint32_t n){
+  static uint32_t idx[SWEEP_BATCH];
+  const uint32_t hist_mask = s->hist_mask[g];
+  const uint32_t table_mask = s->table_mask[g];
+  const uint64_t lane_max = s->lane_max;
+  const uint64_t lane_taken = s->lane_taken;
+  const uint64_t lane_one = s->lane_one;
+  uint64_t *table = s->tables[g];
+
+  for(uint32_t ii = 0; ii < n; ii++){
+    idx[ii] = (pc[ii] ^ (hist[ii] & hist_mask)) & table_mask;
+  }
+
+  uint64_t acc = 0;            // mispredicts per lane, one byte each
+  uint32_t pending = 0;
+  for(uint32_t ii = 0; ii < n; ii++){
+    uint64_t ctr = table[idx[ii]];
+    acc += LaneNonZero(ctr & lane_taken) ^ (dir[ii] ? lane_one : 0);
+    table[idx[ii]] = dir[ii] ? LaneSatIncrement(ctr, lane_max) : LaneSatDecrement(ctr);
+    if(++pending == SWEEP_FLUSH){
+      sweep_flush(s, g, acc);
+      acc = 0;
+      pending = 0;
+    }
+  }
+  sweep_flush(s, g, acc);
+}
+
+void bpred_sweep_run(BPRED_Sweep *s, const Trace_Branch_Rec *recs, uint64_t n){
+  static uint32_t pc[SWEEP_BATCH];
+  static uint32_t hist[SWEEP_BATCH];   // hist_len <= table_bits <= 28
+  static uint8_t  dir[SWEEP_BATCH];
+
+  while(n > 0){
+    uint32_t batch = (n < SWEEP_BATCH) ? n : SWEEP_BATCH;
+    for(uint32_t ii = 0; ii < batch; ii++){
+      pc[ii]   = recs[ii].pc;
+      dir[ii]  = recs[ii].dir ? 1 : 0;
+      hist[ii] = (uint32_t) s->ghr;
+      s->ghr   = (s->ghr << 1) | dir[ii];
+    }
+    for(uint32_t g = 0; g < s->num_groups; g++){
+      sweep_group(s, g, pc, hist, dir, batch);
+    }
+    s->num_branches += batch;
+    recs += batch;
+    n -= batch;
+  }
+}
+
+/////////////////////////////////////////////////////////////
+// Reports
+/////////////////////////////////////////////////////////////
+
+static double sweep_mpki(const BPRED_Sweep *s, uint32_t g, uint32_t k, uint64_t num_insts){
+  return num_insts ? 1000.0 * s->mispred[g * SWEEP_MAX_LANES + k] / num_insts : 0;
+}
+
+void bpred_sweep_csv(const BPRED_Sweep *s, uint64_t num_insts, FILE *out){
+  fprintf(out, "table_bits,hist_len,ctr_bits,storage_kbits,branches,mispred,mispred_rate,mpki\n");
+  for(uint32_t g = 0; g < s->num_groups; g++){
+    for(uint32_t k = 0; k < s->num_lanes; k++){
+      uint64_t mispred = s->mispred[g * SWEEP_MAX_LANES + k];
+      fprintf(out, "%u,%u,%u,%.3f,%llu,%llu,%.4f,%.4f\n",
+              s->table_bits[g], s->hist_len[g], s->ctr_bits[k],
+              ((double)((uint64_t)1 << s->table_bits[g]) * s->ctr_bits[k]) / 1024,
+              (unsigned long long) s->num_branches, (unsigned long long) mispred,
+              s->num_branches ? 100.0 * mispred / s->num_branches : 0,
+              sweep_mpki(s, g, k, num_insts));
+    }
+  }
+}
+
+void bpred_sweep_heatmap(const BPRED_Sweep *s, uint64_t num_insts, FILE *out){
+  if(s->num_groups == 0){
+    return;
+  }
+  // groups are laid out table bits major, history minor
+  uint32_t bits_lo = s->table_bits[0], bits_hi = s->table_bits[s->num_groups - 1];
+  uint32_t hist_lo = 64, hist_hi = 0;
+  for(uint32_t g = 0; g < s->num_groups; g++){
+    if(s->hist_len[g] < hist_lo) hist_lo = s->hist_len[g];
+    if(s->hist_len[g] > hist_hi) hist_hi = s->hist_len[g];
+  }
+
+  for(uint32_t k = 0; k < s->num_lanes; k++){
+    fprintf(out, "\nMPKI, %u-bit counters (rows: history bits, columns: log2 table entries)\n",
+            s->ctr_bits[k]);
+    fprintf(out, "%6s", "");
+    for(uint32_t g = 0; g < s->num_groups; g++){
+      if(g == 0 || s->table_bits[g] != s->table_bits[g - 1]){
+        fprintf(out, " %8u", s->table_bits[g]);
+      }
+    }
+    fprintf(out, "\n");
+
+    for(uint32_t h = hist_lo; h <= hist_hi; h++){
+      bool row = false;
+      for(uint32_t g = 0; g < s->num_groups && !row; g++){
+        row = s->hist_len[g] == h;
+      }
+      if(!row){
+        continue;
+      }
+      fprintf(out, "%6u", h);
+      for(uint32_t b = bits_lo; b <= bits_hi; b++){
+        bool col = false;
+        int32_t hit = -1;
+        for(uint32_t g = 0; g < s->num_groups; g++){
+          if(s->table_bits[g] == b){
+            col = true;
+            if(s->hist_len[g] == h){
+              hit = g;
+            }
+          }
+        }
+        if(!col){
+          continue;
+        }
+        if(hit < 0){
+          fprintf(out, " %8s", "-");
+        } else {
+          fprintf(out, " %8.3f", sweep_mpki(s, hit, k, num_insts));
+        }
+      }
+      fprintf(out, "\n");
+    }
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef _BPRED_SWEEP_H_
+#define _BPRED_SWEEP_H_
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "trace_format.h"
+
+/////////////////////////////////////////////////////////////
+// Single-pass gshare sweep
+//
+// Runs many gshare configurations (table bits x history bits x
+// counter bits) side by side over one branch stream; a history of 0
+// bits is plain bimodal. Every configuration sees the same global
+// history, so configurations that differ only in counter width also
+// share every table index. Those are one group: each table entry is
+// a 64-bit word holding one byte-wide counter per swept width, and
+// SatIncrement / SatDecrement, the taken test and the mispredict count
+// run on all of them at once with byte-lane bit tricks. Groups are
+// run one after another over a batch of branches, so the table being
+// updated stays in cache. Each lane matches BPRED_GSHARE with the
+// same BPRED_Config exactly.
+/////////////////////////////////////////////////////////////
+
+#define SWEEP_MAX_LANES  8        // counter widths per group, one byte each
+
+typedef struct BPRED_Sweep_Range_Struct {
+  uint32_t lo, hi, step;
+} BPRED_Sweep_Range;
+
+typedef struct BPRED_Sweep_Struct {
+  uint32_t  num_groups;     // table bits x history bits points
+  uint32_t  num_lanes;      // counter widths
+  uint32_t  ctr_bits[SWEEP_MAX_LANES];
+
+  // one byte lane per counter width
+  uint64_t  lane_max;       // ctr_max in each lane
+  uint64_t  lane_taken;     // taken bit in each lane
+  uint64_t  lane_one;       // 1 in each used lane
+
+  // one entry per group
+  uint32_t *table_bits;
+  uint32_t *hist_len;
+  uint32_t *hist_mask;      // history bits xor'd into the PC (<= table_bits)
+  uint32_t *table_mask;
+  uint64_t **tables;
+  uint64_t *mispred;        // num_groups x SWEEP_MAX_LANES
+
+  uint64_t  ghr;
+  uint64_t  num_branches;
+} BPRED_Sweep;
+
+/* Parse "lo[:hi[:step]]"; false if malformed */
+bool bpred_sweep_range(const char *arg, BPRED_Sweep_Range *r);
+
+/* One configuration per point of bits x hist x ctr with hist <= bits.
+ * false (with *why set) if a point is out of range or the tables would
+ * not fit in memory. */
+bool bpred_sweep_init(BPRED_Sweep *s, const BPRED_Sweep_Range *bits,
+                      const BPRED_Sweep_Range *hist, const BPRED_Sweep_Range *ctr,
+                      const char **why);
+void bpred_sweep_free(BPRED_Sweep *s);
+
+uint32_t bpred_sweep_configs(const BPRED_Sweep *s);
+
+/* Predict and train every configuration on n resolved branches */
+void bpred_sweep_run(BPRED_Sweep *s, const Trace_Branch_Rec *recs, uint64_t n);
+
+/* One CSV row per configuration */
+void bpred_sweep_csv(const BPRED_Sweep *s, uint64_t num_insts, FILE *out);
+
+/* MPKI as a history x table-bits grid, one per counter width */
+void bpred_sweep_heatmap(const BPRED_Sweep *s, uint64_t num_insts, FILE *out);
+
+#endif
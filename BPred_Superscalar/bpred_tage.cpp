@@ -0,0 +1,255 @@
+#include "bpred_impl.h"
+
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////
+// TAGE: a bimodal base table plus tagged tables indexed with
+// geometrically longer slices of global history. The longest
+// matching table provides the prediction; a mispredict allocates
+// an entry in a longer table. A simplified variant of Seznec's
+// predictor: 64 bits of history at most, no loop predictor.
+//
+// The tagged tables share one array of 64-byte buckets picked by
+// PC and the shortest history. Entries are packed into 16 bits,
+// each table owns 32 / tage_tables ways of every bucket and finds
+// its entry by tag, so a lookup reads a single cache line for all
+// the tagged tables (plus one word of the base table) however large
+// they are. Each table still holds about 2^tage_bits entries.
+/////////////////////////////////////////////////////////////
+
+#define TAGE_CTR_MAX     3         // signed 3-bit counters, taken if >= 0
+#define TAGE_CTR_MIN     (-4)
+#define TAGE_U_MAX       3
+#define TAGE_USE_ALT_MAX 15
+#define TAGE_AGE_PERIOD  (1 << 18) // updates between halvings of u
+#define TAGE_LINE_WAYS   32        // entries per 64-byte bucket
+#define TAGE_NO_TAG      0x7FF     // empty way, never a computed tag (<= 10 bits)
+
+// xor-fold the low len bits of ghr down to bits bits
+static inline uint32_t FoldHist(uint64_t ghr, uint32_t len, uint32_t bits)
+{
+    if(bits == 0)
+        return 0;
+    uint64_t h = ghr & HistMask(len);
+    uint32_t out = 0;
+    for(; h; h >>= bits)
+        out ^= h & HistMask(bits);
+    return out;
+}
+
+typedef struct TAGE_Entry_Struct {
+  uint16_t tag : 11;
+  int16_t  ctr : 3;
+  uint16_t u   : 2;                // usefulness
+} TAGE_Entry;
+
+typedef struct TAGE_Bucket_Struct {
+  TAGE_Entry way[TAGE_LINE_WAYS];
+} TAGE_Bucket;
+
+static_assert(sizeof(TAGE_Bucket) == 64, "a TAGE bucket must fill one cache line");
+
+class BPRED_Tage : public BPRED_Impl {
+public:
+  BPRED_Tage(const BPRED_Config &cfg)
+    : base(cfg.table_bits, cfg.ctr_bits), num_tables(cfg.tage_tables),
+      ways(TAGE_LINE_WAYS / cfg.tage_tables), tag_bits(cfg.tage_tag_bits),
+      hist_len(cfg.tage_tables), use_alt(TAGE_USE_ALT_MAX / 2),
+      num_updates(0), alloc_tick(0), last_valid(false) {
+    for(uint32_t t = 0; t < num_tables; t++){
+      double ratio = (num_tables > 1) ? (double)t / (num_tables - 1) : 1.0;
+      hist_len[t] = (uint32_t)(cfg.tage_min_hist
+                    * pow((double)cfg.tage_max_hist / cfg.tage_min_hist, ratio) + 0.5);
+    }
+    // enough buckets that each table keeps 2^tage_bits entries
+    num_buckets = ((1u << cfg.tage_bits) + ways - 1) / ways;
+    if(posix_memalign((void **)&buckets, sizeof(TAGE_Bucket), num_buckets * sizeof(TAGE_Bucket)))
+      abort();
+    for(size_t b = 0; b < num_buckets; b++){
+      for(uint32_t k = 0; k < TAGE_LINE_WAYS; k++){
+        buckets[b].way[k].tag = TAGE_NO_TAG;
+        buckets[b].way[k].ctr = 0;
+        buckets[b].way[k].u = 0;
+      }
+    }
+  }
+
+  ~BPRED_Tage() {
+    free(buckets);
+  }
+
+  bool Predict(uint32_t PC, uint64_t ghr) {
+    return Find(PC, ghr).pred;
+  }
+
+  void Update(uint32_t PC, uint64_t ghr, bool resolveDir, bool /*predDir*/) {
+    Lookup l = Find(PC, ghr);
+    last_valid = false;
+
+    if(l.provider >= 0){
+      TAGE_Entry &e = *l.entry[l.provider];
+      // learn whether fresh entries are worse than the alternate
+      if(l.weak && l.provider_dir != l.alt_dir){
+        use_alt = (resolveDir == l.alt_dir) ? SatIncrement(use_alt, TAGE_USE_ALT_MAX)
+                                            : SatDecrement(use_alt);
+      }
+      if(l.provider_dir != l.alt_dir){
+        e.u = (resolveDir == l.provider_dir) ? SatIncrement(e.u, TAGE_U_MAX) : SatDecrement(e.u);
+      }
+      if(resolveDir){
+        e.ctr += (e.ctr < TAGE_CTR_MAX);
+      } else {
+        e.ctr -= (e.ctr > TAGE_CTR_MIN);
+      }
+    } else {
+      base.Update(PC, resolveDir);
+    }
+
+    // on a mispredict, claim a not-useful way of a longer table
+    if(l.pred != resolveDir && l.provider < (int32_t)num_tables - 1){
+      int32_t pick = -1;
+      TAGE_Entry *victim = NULL;
+      for(int32_t t = l.provider + 1; t < (int32_t)num_tables; t++){
+        TAGE_Entry *free_way = FreeWay(l.bucket, t);
+        if(free_way){
+          pick = t;
+          victim = free_way;
+          // sometimes skip to the next free one so allocations spread out
+          if((++alloc_tick & 1) == 0)
+            break;
+        }
+      }
+      if(pick >= 0){
+        victim->tag = l.tag[pick];
+        victim->ctr = resolveDir ? 0 : -1;
+        victim->u = 0;
+      } else {
+        for(int32_t t = l.provider + 1; t < (int32_t)num_tables; t++){
+          TAGE_Entry *w = Way(l.bucket, t, 0);
+          for(uint32_t k = 0; k < ways; k++)
+            w[k].u = SatDecrement(w[k].u);
+        }
+      }
+    }
+
+    if(++num_updates % TAGE_AGE_PERIOD == 0){
+      for(size_t b = 0; b < num_buckets; b++)
+        for(uint32_t k = 0; k < TAGE_LINE_WAYS; k++)
+          buckets[b].way[k].u >>= 1;
+    }
+  }
+
+  size_t Bytes() const {
+    return base.Bytes() + num_buckets * sizeof(TAGE_Bucket);
+  }
+
+private:
+  typedef struct Lookup_Struct {
+    TAGE_Bucket *bucket;
+    int32_t  provider;             // longest matching table, -1 for the base
+    int32_t  alt;                  // next longest match, -1 for the base
+    TAGE_Entry *entry[16];         // matching way per table, or NULL
+    uint16_t tag[16];
+    bool     provider_dir;
+    bool     alt_dir;
+    bool     weak;                 // provider is a fresh, unproven entry
+    bool     pred;
+  } Lookup;
+
+  BPRED_Counters base;
+  uint32_t num_tables;
+  uint32_t ways;                   // ways of each bucket per table
+  uint32_t tag_bits;
+  std::vector<uint32_t> hist_len;
+  TAGE_Bucket *buckets;
+  size_t   num_buckets;
+  uint32_t use_alt;
+  uint64_t num_updates;
+  uint32_t alloc_tick;
+
+  // GetPrediction and UpdatePredictor look up the same branch back to
+  // back; keep the first answer until a table changes
+  bool     last_valid;
+  uint32_t last_pc;
+  uint64_t last_ghr;
+  Lookup   last;
+
+  TAGE_Entry* Way(TAGE_Bucket *b, uint32_t t, uint32_t k) {
+    return &b->way[t * ways + k];
+  }
+
+  // a not-useful way to replace: an empty one, else the least confident
+  TAGE_Entry* FreeWay(TAGE_Bucket *b, uint32_t t) {
+    TAGE_Entry *w = Way(b, t, 0);
+    TAGE_Entry *best = NULL;
+    int32_t best_conf = 0;
+    for(uint32_t k = 0; k < ways; k++){
+      if(w[k].u != 0)
+        continue;
+      if(w[k].tag == TAGE_NO_TAG)
+        return &w[k];
+      int32_t conf = (w[k].ctr >= 0) ? w[k].ctr : -1 - w[k].ctr;
+      if(best == NULL || conf < best_conf){
+        best = &w[k];
+        best_conf = conf;
+      }
+    }
+    return best;
+  }
+
+  const Lookup& Find(uint32_t PC, uint64_t ghr) {
+    if(last_valid && last_pc == PC && last_ghr == ghr)
+      return last;
+
+    Lookup *l = &last;
+    uint32_t tag_mask = HistMask(tag_bits);
+    uint32_t h = (PC ^ (PC >> 16) ^ FoldHist(ghr, hist_len[0], 16)) * 0x9E3779B1u;
+    l->bucket = &buckets[((uint64_t)h * num_buckets) >> 32];
+
+    l->provider = -1;
+    l->alt = -1;
+    for(int32_t t = num_tables - 1; t >= 0; t--){
+      uint32_t len = hist_len[t];
+      l->tag[t] = (PC ^ FoldHist(ghr, len, tag_bits) ^ (FoldHist(ghr, len, tag_bits - 1) << 1)) & tag_mask;
+      l->entry[t] = NULL;
+      TAGE_Entry *w = Way(l->bucket, t, 0);
+      for(uint32_t k = 0; k < ways; k++){
+        if(w[k].tag == l->tag[t]){
+          l->entry[t] = &w[k];
+          break;
+        }
+      }
+      if(l->entry[t]){
+        if(l->provider < 0){
+          l->provider = t;
+        } else if(l->alt < 0){
+          l->alt = t;
+        }
+      }
+    }
+
+    l->alt_dir = (l->alt >= 0) ? l->entry[l->alt]->ctr >= 0 : base.Predict(PC);
+    if(l->provider < 0){
+      l->provider_dir = l->alt_dir;
+      l->weak = false;
+      l->pred = l->alt_dir;
+    } else {
+      const TAGE_Entry &e = *l->entry[l->provider];
+      l->provider_dir = e.ctr >= 0;
+      l->weak = (e.ctr == 0 || e.ctr == -1) && e.u == 0;
+      l->pred = (l->weak && use_alt > TAGE_USE_ALT_MAX / 2) ? l->alt_dir : l->provider_dir;
+    }
+
+    last_valid = true;
+    last_pc = PC;
+    last_ghr = ghr;
+    return last;
+  }
+};
+
+BPRED_Impl* bpred_new_tage(const BPRED_Config &cfg){
+  return new BPRED_Tage(cfg);
+}
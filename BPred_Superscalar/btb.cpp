@@ -0,0 +1,70 @@
+#include "btb.h"
+
+/////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////
+
+BTB::BTB(uint32_t entries_in, uint32_t ways){
+  num_ways = ways;
+  num_sets = entries_in / ways;
+  tick = 0;
+  stat_num_lookups = 0;
+  stat_num_misses = 0;
+
+  BTB_Entry empty = {0, 0, 0, false};
+  entries.assign((size_t)num_sets * num_ways, empty);
+}
+
+bool BTB::Lookup(uint64_t PC, uint64_t target){
+  BTB_Entry *set = Set(PC);
+  stat_num_lookups++;
+  for(uint32_t ii = 0; ii < num_ways; ii++){
+    if(set[ii].valid && set[ii].tag == PC){
+      set[ii].lru = ++tick;
+      if(set[ii].target == target){
+        return true;
+      }
+      break;
+    }
+  }
+  stat_num_misses++;
+  return false;
+}
+
+void BTB::Update(uint64_t PC, uint64_t target){
+  BTB_Entry *set = Set(PC);
+  BTB_Entry *victim = &set[0];
+  for(uint32_t ii = 0; ii < num_ways; ii++){
+    if(set[ii].valid && set[ii].tag == PC){
+      victim = &set[ii];
+      break;
+    }
+    if(!set[ii].valid || (victim->valid && set[ii].lru < victim->lru)){
+      victim = &set[ii];
+    }
+  }
+  victim->valid = true;
+  victim->tag = PC;
+  victim->target = target;
+  victim->lru = ++tick;
+}
+
+/////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////
+
+void ras_push(RAS *ras, uint64_t return_addr){
+  ras->top = (ras->top + 1) % RAS_SIZE;
+  ras->stack[ras->top] = return_addr;
+  if(ras->depth < RAS_SIZE){
+    ras->depth++;
+  }
+}
+
+bool ras_pop(RAS *ras, uint64_t *return_addr){
+  if(ras->depth == 0){
+    return false;
+  }
+  *return_addr = ras->stack[ras->top];
+  ras->top = (ras->top + RAS_SIZE - 1) % RAS_SIZE;
+  ras->depth--;
+  return true;
+}
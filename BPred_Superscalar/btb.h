@@ -0,0 +1,71 @@
+#ifndef _BTB_H_
+#define _BTB_H_
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// Branch target buffer: set associative, keyed on the full
+// inst_addr, LRU within a set. Fetch looks a predicted-taken
+// branch up to get its target; a miss (or a stale target) is only
+// fixed when decode works the target out, which costs a bubble.
+/////////////////////////////////////////////////////////////
+
+class BTB {
+public:
+  uint64_t stat_num_lookups;
+  uint64_t stat_num_misses;        // no entry, or the wrong target
+
+  BTB(uint32_t entries, uint32_t ways);
+
+  // true if PC hits and the stored target is target
+  bool Lookup(uint64_t PC, uint64_t target);
+  void Update(uint64_t PC, uint64_t target);
+
+private:
+  typedef struct BTB_Entry_Struct {
+    uint64_t tag;                  // inst_addr
+    uint64_t target;
+    uint64_t lru;                  // last use, larger is newer
+    bool     valid;
+  } BTB_Entry;
+
+  uint32_t num_sets;
+  uint32_t num_ways;
+  uint64_t tick;
+  std::vector<BTB_Entry> entries;
+
+  BTB_Entry* Set(uint64_t PC) {
+    return &entries[(PC % num_sets) * num_ways];
+  }
+};
+
+/////////////////////////////////////////////////////////////
+// Return address stack. A call pushes its fall-through address
+// and a return predicts the top; it wraps when full, as the
+// hardware does. Only reached for branches pipe_branch_kind()
+// classifies as calls or returns.
+/////////////////////////////////////////////////////////////
+
+#define RAS_SIZE       16
+#define RAS_CALL_BYTES 5          // x86 near call: the return lands right after it
+
+typedef enum Branch_Kind_Enum {
+    BR_NONE,
+    BR_COND,
+    BR_CALL,
+    BR_RETURN
+} Branch_Kind;
+
+typedef struct RAS_Struct {
+  uint64_t stack[RAS_SIZE];
+  uint32_t top;
+  uint32_t depth;
+  uint64_t stat_num_returns;
+  uint64_t stat_num_mispred;
+} RAS;
+
+void ras_push(RAS *ras, uint64_t return_addr);
+bool ras_pop(RAS *ras, uint64_t *return_addr);    // false if empty
+
+#endif
@@ -0,0 +1,203 @@
+/********************************************************************
+ * File         : hazard_bench.cpp
+ * Description  : Micro-benchmark for the ID stage hazard check
+ *********************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pipeline.h"
+#include "pipe_hazard.h"
+
+#define BENCH_CASES 4096         // random stage contents checked against each other
+#define BENCH_HOT   16           // ... and the first few timed, small enough to stay in cache
+#define BENCH_MAX_WIDTH 16
+
+
+/*********************************************************************
+ * Global Scope Functions
+ *********************************************************************/
+
+void die_usage() {
+    printf("Usage : hazard_bench [options]\n\n");
+    printf("Times the EX/MEM hazard check of one decode group at widths 1..16:\n");
+    printf("the lab model's pairwise compares over the latches, and the vector\n");
+    printf("scan in pipe_hazard.h with each kernel this CPU has\n");
+    printf("Options\n");
+    printf("   -iters       <num>    Checks timed per width and method (Default: 2000000)\n");
+    printf("   -regs        <num>    Registers the random ops use, 1..256 (Default: 32)\n");
+    exit(0);
+}
+
+// a latch as the lab model had it, the whole record copied in
+typedef struct Bench_Latch_Struct {
+  bool valid;
+  Trace_Rec tr_entry;
+} Bench_Latch;
+
+typedef struct Bench_Case_Struct {
+  Bench_Latch id[BENCH_MAX_WIDTH];
+  Bench_Latch ex[BENCH_MAX_WIDTH];
+  Bench_Latch mem[BENCH_MAX_WIDTH];
+} Bench_Case;
+
+static void bench_op(Bench_Latch *op, uint32_t regs){
+  memset(op, 0, sizeof(Bench_Latch));
+  op->valid                = rand() % 4 != 0;
+  op->tr_entry.op_type     = rand() % NUM_OP_TYPE;
+  op->tr_entry.dest        = rand() % regs;
+  op->tr_entry.dest_needed = rand() % 4 != 0;
+  op->tr_entry.src1_reg    = rand() % regs;
+  op->tr_entry.src1_needed = rand() % 4 != 0;
+  op->tr_entry.src2_reg    = rand() % regs;
+  op->tr_entry.src2_needed = rand() % 2;
+  op->tr_entry.cc_read     = rand() % 8 == 0;
+  op->tr_entry.cc_write    = rand() % 8 == 0;
+}
+
+static double bench_now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+
+/*********************************************************************
+ * The two methods, no forwarding: every valid EX and MEM op is a
+ * producer. Each returns one bit per ID slot with a hazard.
+ *********************************************************************/
+
+static inline bool bench_pair(const Bench_Latch *id, const Bench_Latch *prod){
+  return prod->valid
+      && ((id->tr_entry.src1_needed && prod->tr_entry.dest_needed && id->tr_entry.src1_reg == prod->tr_entry.dest)
+          || (id->tr_entry.src2_needed && prod->tr_entry.dest_needed && id->tr_entry.src2_reg == prod->tr_entry.dest)
+          || (id->tr_entry.cc_read && prod->tr_entry.cc_write));
+}
+
+static uint64_t bench_pairwise(const Bench_Case *c, int width){
+  uint64_t hazards = 0;
+  for(int ii = 0; ii < width; ii++){
+    for(int jj = 0; jj < width; jj++){
+      if(bench_pair(&c->id[ii], &c->ex[jj]) || bench_pair(&c->id[ii], &c->mem[jj])){
+        hazards |= (uint64_t)1 << ii;
+      }
+    }
+  }
+  return hazards;
+}
+
+static uint64_t bench_scan(Hazard_Kernel kernel, const Bench_Case *c, int width){
+  Pipe_Producers pp;
+  Pipe_Consumers pc;
+  pipe_producers_init(&pp);
+  pipe_consumers_init(&pc);
+  for(int ii = 0; ii < width; ii++){
+    const Trace_Rec *ex = &c->ex[ii].tr_entry;
+    const Trace_Rec *mem = &c->mem[ii].tr_entry;
+    const Trace_Rec *id = &c->id[ii].tr_entry;
+    if(c->ex[ii].valid){
+      pipe_producers_add(&pp, ex->dest, ex->dest_needed, ex->cc_write);
+    }
+    if(c->mem[ii].valid){
+      pipe_producers_add(&pp, mem->dest, mem->dest_needed, mem->cc_write);
+    }
+    pipe_consumers_add(&pc, id->src1_reg, id->src1_needed, id->src2_reg, id->src2_needed, id->cc_read);
+  }
+  uint64_t hazards = 0;
+  pipe_hazard_scan_with(kernel, &pp, &pc, &hazards);
+  return hazards;
+}
+
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char *argv[])
+{
+    uint64_t iters = 2000000;
+    uint32_t regs = 32;
+
+    for (int ii = 1; ii < argc; ii++) {
+      if (!strcmp(argv[ii], "-iters") && ii < argc - 1) {
+        iters = strtoull(argv[++ii], NULL, 10);
+      } else if (!strcmp(argv[ii], "-regs") && ii < argc - 1) {
+        regs = atoi(argv[++ii]);
+      } else {
+        die_usage();
+      }
+    }
+    if (regs < 1 || regs > NUM_REGS || iters == 0) {
+      die_usage();
+    }
+
+    Bench_Case *cases = (Bench_Case *) calloc (BENCH_CASES, sizeof (Bench_Case));
+    srand(1);
+    for (int c = 0; c < BENCH_CASES; c++) {
+      for (int ii = 0; ii < BENCH_MAX_WIDTH; ii++) {
+        bench_op(&cases[c].id[ii], regs);
+        bench_op(&cases[c].ex[ii], regs);
+        bench_op(&cases[c].mem[ii], regs);
+      }
+    }
+
+    // a kernel is there if an empty scan runs
+    bool have[NUM_HAZARD_KERNEL];
+    Pipe_Producers no_pp;
+    Pipe_Consumers no_pc;
+    pipe_producers_init(&no_pp);
+    pipe_consumers_init(&no_pc);
+
+    printf("default kernel: %s\n\n", pipe_hazard_kernel_name(pipe_hazard_kernel()));
+    printf("%5s %12s", "width", "pairwise_ns");
+    for (int k = 0; k < NUM_HAZARD_KERNEL; k++) {
+      uint64_t unused;
+      have[k] = pipe_hazard_scan_with((Hazard_Kernel)k, &no_pp, &no_pc, &unused);
+      if (have[k]) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s_ns", pipe_hazard_kernel_name((Hazard_Kernel)k));
+        printf(" %10s %8s", name, "speedup");
+      }
+    }
+    printf("\n");
+
+    for (int width = 1; width <= BENCH_MAX_WIDTH; width++) {
+      // every method has to agree before it is timed
+      for (int c = 0; c < BENCH_CASES; c++) {
+        uint64_t want = bench_pairwise(&cases[c], width);
+        for (int k = 0; k < NUM_HAZARD_KERNEL; k++) {
+          if (have[k] && bench_scan((Hazard_Kernel)k, &cases[c], width) != want) {
+            printf("Error! %s kernel disagrees at width %d. Exiting...\n",
+                   pipe_hazard_kernel_name((Hazard_Kernel)k), width);
+            exit(1);
+          }
+        }
+      }
+
+      volatile uint64_t sink = 0;
+      double t0 = bench_now();
+      for (uint64_t it = 0; it < iters; it++) {
+        sink += bench_pairwise(&cases[it % BENCH_HOT], width);
+      }
+      double pairwise_ns = 1e9 * (bench_now() - t0) / iters;
+      printf("%5d %12.2f", width, pairwise_ns);
+
+      for (int k = 0; k < NUM_HAZARD_KERNEL; k++) {
+        if (!have[k]) {
+          continue;
+        }
+        t0 = bench_now();
+        for (uint64_t it = 0; it < iters; it++) {
+          sink += bench_scan((Hazard_Kernel)k, &cases[it % BENCH_HOT], width);
+        }
+        double ns = 1e9 * (bench_now() - t0) / iters;
+        printf(" %10.2f %7.2fx", ns, pairwise_ns / ns);
+      }
+      printf("\n");
+    }
+
+    free(cases);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "pipe_hazard.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAZARD_X86
+#include <immintrin.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// Kernels: each returns, for one register, the producers whose dest
+// is that register; the caller masks off the ones that do not write.
+/////////////////////////////////////////////////////////////
+
+static inline uint64_t match_scalar(const Pipe_Producers *pp, uint8_t reg){
+  uint64_t match = 0;
+  for(uint32_t ii = 0; ii < pp->num; ii++){
+    match |= (uint64_t)(pp->dest[ii] == reg) << ii;
+  }
+  return match;
+}
+
+#ifdef HAZARD_X86
+static inline uint64_t match_sse2(const Pipe_Producers *pp, uint8_t reg){
+  const __m128i key = _mm_set1_epi8((char)reg);
+  uint64_t match = 0;
+  for(uint32_t ii = 0; ii < pp->num; ii += 16){
+    __m128i dest = _mm_loadu_si128((const __m128i *)(pp->dest + ii));
+    match |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(dest, key)) << ii;
+  }
+  return match;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t match_avx2(const Pipe_Producers *pp, uint8_t reg){
+  const __m256i key = _mm256_set1_epi8((char)reg);
+  uint64_t match = 0;
+  for(uint32_t ii = 0; ii < pp->num; ii += 32){
+    __m256i dest = _mm256_loadu_si256((const __m256i *)(pp->dest + ii));
+    match |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(dest, key)) << ii;
+  }
+  return match;
+}
+#endif
+
+// one scan per kernel, so the match inlines into the consumer loop
+#define HAZARD_SCAN(name, match)                                          \
+  static uint64_t name(const Pipe_Producers *pp, const Pipe_Consumers *pc){ \
+    uint64_t hazards = pp->cc ? pc->cc_read : 0;                          \
+    if(pp->writes == 0){                                                  \
+      return hazards;                                                     \
+    }                                                                     \
+    for(uint32_t ii = 0; ii < pc->num; ii++){                             \
+      uint64_t bit = (uint64_t)1 << ii;                                   \
+      if(((pc->src1_needed & bit) && (match(pp, pc->src1[ii]) & pp->writes)) \
+         || ((pc->src2_needed & bit) && (match(pp, pc->src2[ii]) & pp->writes))){ \
+        hazards |= bit;                                                   \
+      }                                                                   \
+    }                                                                     \
+    return hazards;                                                       \
+  }
+
+HAZARD_SCAN(scan_scalar, match_scalar)
+#ifdef HAZARD_X86
+HAZARD_SCAN(scan_sse2, match_sse2)
+__attribute__((target("avx2"))) HAZARD_SCAN(scan_avx2, match_avx2)
+#endif
+
+/////////////////////////////////////////////////////////////
+// Dispatch
+/////////////////////////////////////////////////////////////
+
+typedef uint64_t (*Hazard_Scan_Fn)(const Pipe_Producers *, const Pipe_Consumers *);
+
+static bool cpu_supports(Hazard_Kernel kernel){
+#ifdef HAZARD_X86
+  __builtin_cpu_init();           // may run from a static initializer
+#endif
+  switch(kernel){
+    case HAZARD_SCALAR: return true;
+#ifdef HAZARD_X86
+    case HAZARD_SSE2:   return __builtin_cpu_supports("sse2");
+    case HAZARD_AVX2:   return __builtin_cpu_supports("avx2");
+#endif
+    default:            return false;
+  }
+}
+
+static Hazard_Scan_Fn kernel_fn(Hazard_Kernel kernel){
+  switch(kernel){
+#ifdef HAZARD_X86
+    case HAZARD_SSE2:   return scan_sse2;
+    case HAZARD_AVX2:   return scan_avx2;
+#endif
+    default:            return scan_scalar;
+  }
+}
+
+// probed once, before main
+static struct Hazard_Dispatch {
+  bool supported[NUM_HAZARD_KERNEL];
+  Hazard_Kernel best;
+  Hazard_Scan_Fn scan;
+
+  Hazard_Dispatch() {
+    best = HAZARD_SCALAR;
+    for(int k = HAZARD_SCALAR; k < NUM_HAZARD_KERNEL; k++){
+      supported[k] = cpu_supports((Hazard_Kernel)k);
+      if(supported[k]){
+        best = (Hazard_Kernel)k;
+      }
+    }
+    scan = kernel_fn(best);
+  }
+} HAZARD_DISPATCH;
+
+uint64_t pipe_hazard_scan(const Pipe_Producers *pp, const Pipe_Consumers *pc){
+  return HAZARD_DISPATCH.scan(pp, pc);
+}
+
+bool pipe_hazard_scan_with(Hazard_Kernel kernel, const Pipe_Producers *pp,
+                           const Pipe_Consumers *pc, uint64_t *hazards){
+  if(kernel >= NUM_HAZARD_KERNEL || !HAZARD_DISPATCH.supported[kernel]){
+    return false;
+  }
+  *hazards = kernel_fn(kernel)(pp, pc);
+  return true;
+}
+
+Hazard_Kernel pipe_hazard_kernel(void){
+  return HAZARD_DISPATCH.best;
+}
+
+const char* pipe_hazard_kernel_name(Hazard_Kernel kernel){
+  switch(kernel){
+    case HAZARD_SCALAR: return "scalar";
+    case HAZARD_SSE2:   return "sse2";
+    case HAZARD_AVX2:   return "avx2";
+    default:            return "?";
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef _PIPE_HAZARD_H
+#define _PIPE_HAZARD_H
+
+#include <inttypes.h>
+
+/////////////////////////////////////////////////////////////
+// Vectorized hazard check. The ops that may still write a register
+// (producers, e.g. the EX and MEM latches) and the ops reading them
+// (consumers, the ID latch) are laid out as structures of arrays, so
+// a consumer's source is compared against every producer's dest with
+// one SIMD byte compare, and the movemask is and'ed with the producers
+// that really write. AVX2 or SSE2 is picked at startup, with a scalar
+// fallback for other CPUs.
+/////////////////////////////////////////////////////////////
+
+#define HAZARD_MAX_OPS 64         // bits in the masks; a multiple of the vector width
+
+typedef struct Pipe_Producers_Struct {
+  uint8_t  dest[HAZARD_MAX_OPS];  // entries past num are compared but masked off
+  uint64_t writes;                // bit i: producer i writes dest[i]
+  bool     cc;                    // some producer writes the condition codes
+  uint32_t num;
+} Pipe_Producers;
+
+typedef struct Pipe_Consumers_Struct {
+  uint8_t  src1[HAZARD_MAX_OPS];
+  uint8_t  src2[HAZARD_MAX_OPS];
+  uint64_t src1_needed;           // bit i: consumer i reads src1[i]
+  uint64_t src2_needed;
+  uint64_t cc_read;
+  uint32_t num;
+} Pipe_Consumers;
+
+typedef enum Hazard_Kernel_Enum {
+    HAZARD_SCALAR,
+    HAZARD_SSE2,
+    HAZARD_AVX2,
+    NUM_HAZARD_KERNEL
+} Hazard_Kernel;
+
+// the arrays need no clearing: entries past num are never trusted
+static inline void pipe_producers_init(Pipe_Producers *pp){
+  pp->writes = 0;
+  pp->cc = false;
+  pp->num = 0;
+}
+
+static inline void pipe_consumers_init(Pipe_Consumers *pc){
+  pc->src1_needed = 0;
+  pc->src2_needed = 0;
+  pc->cc_read = 0;
+  pc->num = 0;
+}
+
+static inline void pipe_producers_add(Pipe_Producers *pp, uint8_t dest, bool dest_needed, bool cc_write){
+  pp->dest[pp->num] = dest;
+  pp->writes |= (uint64_t)dest_needed << pp->num;
+  pp->cc |= cc_write;
+  pp->num++;
+}
+
+static inline void pipe_consumers_add(Pipe_Consumers *pc, uint8_t src1, bool src1_needed,
+                                      uint8_t src2, bool src2_needed, bool cc_read){
+  pc->src1[pc->num] = src1;
+  pc->src2[pc->num] = src2;
+  pc->src1_needed |= (uint64_t)src1_needed << pc->num;
+  pc->src2_needed |= (uint64_t)src2_needed << pc->num;
+  pc->cc_read |= (uint64_t)cc_read << pc->num;
+  pc->num++;
+}
+
+/* bit i set: consumer i reads a register (or the condition codes) some
+ * producer writes */
+uint64_t pipe_hazard_scan(const Pipe_Producers *pp, const Pipe_Consumers *pc);
+
+/* Same, with a given kernel; false if this CPU lacks it */
+bool pipe_hazard_scan_with(Hazard_Kernel kernel, const Pipe_Producers *pp,
+                           const Pipe_Consumers *pc, uint64_t *hazards);
+
+Hazard_Kernel pipe_hazard_kernel(void);           // the one pipe_hazard_scan uses
+const char* pipe_hazard_kernel_name(Hazard_Kernel kernel);
+
+#endif
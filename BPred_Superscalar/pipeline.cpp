@@ -6,36 +6,131 @@
  **********************************************************************/
 
 #include "pipeline.h"
+#include "pipe_hazard.h"
 #include <cstdlib>
+#include <cstring>
 
-extern int32_t PIPE_WIDTH;
-extern int32_t ENABLE_MEM_FWD;
-extern int32_t ENABLE_EXE_FWD;
-extern int32_t BPRED_POLICY;
+/**********************************************************************
+ * Configuration
+ **********************************************************************/
+
+void pipe_config_init(Pipe_Config *cfg){
+    memset(cfg, 0, sizeof(Pipe_Config));
+    cfg->width       = 1;
+    cfg->btb_ways    = 4;
+    cfg->btb_penalty = 1;
+    bpred_config_init(&cfg->bpred);
+}
+
+bool pipe_config_check(const Pipe_Config *cfg, const char **why){
+    const char *err = NULL;
+    if(cfg->width < 1 || cfg->width > MAX_PIPE_WIDTH){
+      err = "-pipewidth must be 1..32";
+    } else if(bpred_config_check(cfg->bpred_policy, &cfg->bpred, &err)
+              && cfg->btb_entries && (cfg->btb_ways == 0 || cfg->btb_entries % cfg->btb_ways)){
+      err = "-btb entries must be a multiple of -btbways";
+    }
+
+    if(why){
+      *why = err;
+    }
+    return err == NULL;
+}
 
 /**********************************************************************
- * Support Function: Read 1 Trace Record From File and populate Fetch Op
+ * Support Function: Next Trace Record, from the prefetch thread if any
  **********************************************************************/
 
-void pipe_get_fetch_op(Pipeline *p, Pipeline_Latch* fetch_op){
-    uint8_t bytes_read = 0;
-    bytes_read = fread(&fetch_op->tr_entry, 1, sizeof(Trace_Rec), p->tr_file);
+static inline const Trace_Rec* pipe_next_trace_rec(Pipeline *p){
+    return p->tr_prefetch ? p->tr_prefetch->Next() : trace_next(p->tr_reader);
+}
+
+/**********************************************************************
+ * Support Function: Make room in the trace window for op_id. Ops are
+ * dropped once no latch names them; an op a latch still names (an
+ * empty slot keeps the last op it held) grows the ring instead.
+ **********************************************************************/
+
+static void pipe_window_alloc(Pipe_Window *w, uint64_t entries){
+    w->rec        = (Trace_Rec *) calloc (entries, sizeof (Trace_Rec));
+    w->bpred_hist = (uint64_t *)  calloc (entries, sizeof (uint64_t));
+    w->flags      = (uint8_t *)   calloc (entries, sizeof (uint8_t));
+    w->mask       = entries - 1;
+}
+
+static void pipe_window_reserve(Pipeline *p, uint64_t op_id){
+    Pipe_Window *w = &p->window;
+    if(op_id - w->oldest <= w->mask) {
+      return;
+    }
+
+    uint64_t oldest = op_id;
+    int width = p->cfg.width;
+    for(int latch = 0; latch < NUM_LATCH_TYPES; latch++) {
+      for(int ii = 0; ii < width; ii++) {
+        uint64_t named = p->pipe_latch[latch].op_id[ii];
+        if(named && named < oldest) {
+          oldest = named;
+        }
+      }
+    }
+    if(p->fetch_op_id && p->fetch_op_id < oldest) {
+      oldest = p->fetch_op_id;
+    }
+    w->oldest = oldest;
+    if(op_id - oldest <= w->mask) {
+      return;
+    }
+
+    uint64_t entries = w->mask + 1;
+    while(op_id - oldest > entries - 1) {
+      entries *= 2;
+    }
+    Pipe_Window grown;
+    pipe_window_alloc(&grown, entries);
+    grown.oldest = oldest;
+    for(uint64_t id = oldest; id < op_id; id++) {
+      grown.rec[id & grown.mask]        = w->rec[id & w->mask];
+      grown.bpred_hist[id & grown.mask] = w->bpred_hist[id & w->mask];
+      grown.flags[id & grown.mask]      = w->flags[id & w->mask];
+    }
+    free(w->rec);
+    free(w->bpred_hist);
+    free(w->flags);
+    *w = grown;
+}
+
+/**********************************************************************
+ * Support Function: Read 1 Trace Record From File into the window as
+ * op op_id_tracker; false at the end of the trace
+ **********************************************************************/
+
+bool pipe_get_fetch_op(Pipeline *p){
+    const Trace_Rec *tr_entry = NULL;
+    if(p->op_id_tracker < p->max_op_id) {
+      tr_entry = pipe_next_trace_rec(p);
+    }
 
     // check for end of trace
-    if( bytes_read < sizeof(Trace_Rec)) {
-      fetch_op->valid=false;
+    if(tr_entry == NULL) {
       p->halt_op_id=p->op_id_tracker;
-      return;
+      // nothing was fetched at all (empty trace, or -skip ran past the end)
+      if(p->stat_retired_inst == p->op_id_tracker) {
+        p->halt=true;
+      }
+      return false;
     }
 
     // got an instruction ... hooray!
-    fetch_op->valid=true;
-    fetch_op->stall=false;
-    fetch_op->is_mispred_cbr=false;
     p->op_id_tracker++;
-    fetch_op->op_id=p->op_id_tracker;
+    pipe_window_reserve(p, p->op_id_tracker);
+    uint64_t slot = p->op_id_tracker & p->window.mask;
+    p->window.rec[slot]=*tr_entry;
+    p->window.flags[slot]=0;
+    p->window.bpred_hist[slot]=0;
+    p->fetch_op_id=p->op_id_tracker;
     
-    return; 
+    return true; 
 }
 
 
@@ -43,23 +138,113 @@ void pipe_get_fetch_op(Pipeline *p, Pipeline_Latch* fetch_op){
  * Pipeline Class Member Functions 
  **********************************************************************/
 
-Pipeline * pipe_init(FILE *tr_file_in){
-    printf("\n** PIPELINE IS %d WIDE **\n\n", PIPE_WIDTH);
+Pipeline * pipe_init(const Pipe_Config *cfg, Trace_Reader *tr_reader_in,
+                     Trace_Prefetcher<Trace_Rec> *tr_prefetch_in){
+    printf("\n** PIPELINE IS %d WIDE **\n\n", cfg->width);
 
     // Initialize Pipeline Internals
     Pipeline *p = (Pipeline *) calloc (1, sizeof (Pipeline));
 
-    p->tr_file = tr_file_in;
+    p->cfg = *cfg;
+    p->tr_reader = tr_reader_in;
+    p->tr_prefetch = tr_prefetch_in;
     p->halt_op_id = ((uint64_t)-1) - 3;           
+    p->max_op_id = (uint64_t)-1;
+    pipe_window_alloc(&p->window, PIPE_WINDOW_SIZE);
 
     // Allocated Branch Predictor
-    if(BPRED_POLICY){
-      p->b_pred = new BPRED(BPRED_POLICY);
+    if(cfg->bpred_policy){
+      p->b_pred = new BPRED(cfg->bpred_policy, cfg->bpred);
     }
+    if(cfg->btb_entries){
+      p->btb = new BTB(cfg->btb_entries, cfg->btb_ways);
+    }
+
+    memset(&p->id_ages, 0xFF, sizeof(p->id_ages));   // PIPE_NO_WRITER
 
     return p;
 }
 
+void pipe_free(Pipeline *p){
+    delete p->b_pred;
+    delete p->btb;
+    free(p->window.rec);
+    free(p->window.bpred_hist);
+    free(p->window.flags);
+    free(p);
+}
+
+
+/**********************************************************************
+ * Functional fast-forward: consume num_inst records with no timing,
+ * training only the long-lived state (predictor and BTB) so the
+ * detailed run that follows starts warm. With nothing to train the
+ * reader just seeks.
+ **********************************************************************/
+
+uint64_t pipe_warm(Pipeline *p, uint64_t num_inst){
+    if(p->b_pred == NULL && p->btb == NULL) {
+      return pipe_seek(p, num_inst);
+    }
+
+    uint64_t ii;
+    for(ii = 0; ii < num_inst; ii++) {
+      const Trace_Rec *tr_entry = pipe_next_trace_rec(p);
+      if(tr_entry == NULL) {
+        break;
+      }
+      if(tr_entry->op_type == OP_CBR && p->b_pred) {
+        bool pred_dir = p->b_pred->GetPrediction(tr_entry->inst_addr);
+        p->b_pred->UpdatePredictor(tr_entry->inst_addr, tr_entry->br_dir, pred_dir);
+      }
+      if(tr_entry->op_type == OP_CBR && tr_entry->br_dir && p->btb) {
+        p->btb->Update(tr_entry->inst_addr, tr_entry->br_target);
+      }
+    }
+    return ii;
+}
+
+
+uint64_t pipe_seek(Pipeline *p, uint64_t num_inst){
+    if(p->tr_prefetch) {
+      uint64_t ii;
+      for(ii = 0; ii < num_inst && p->tr_prefetch->Next() != NULL; ii++);
+      return ii;
+    }
+
+    uint64_t start = p->tr_reader->num_read;
+    trace_seek(p->tr_reader, start + num_inst);
+    return p->tr_reader->num_read - start;
+}
+
+
+/**********************************************************************
+ * Restart a halted (drained) pipeline so the next num_inst records are
+ * simulated in detail. Stats, the predictor and skip_limit carry over.
+ **********************************************************************/
+
+void pipe_resume(Pipeline *p, uint64_t num_inst){
+    // the ops left in the latches have all retired
+    memset(p->pipe_latch, 0, sizeof(p->pipe_latch));
+    p->fetch_cbr_stall = false;
+    p->fetch_resume_cycle = 0;
+    p->halt = false;
+    p->halt_op_id = ((uint64_t)-1) - 3;
+    p->max_op_id = p->op_id_tracker + num_inst;
+}
+
+
+/**********************************************************************
+ * Branch classification for target prediction. The trace format only
+ * marks conditional branches (OP_CBR); calls and returns are folded
+ * into the other op types with no target, so BR_CALL / BR_RETURN (and
+ * the RAS behind them) wait on a trace that records them.
+ **********************************************************************/
+
+static Branch_Kind pipe_branch_kind(const Trace_Rec *tr_entry){
+    return (tr_entry->op_type == OP_CBR) ? BR_COND : BR_NONE;
+}
+
 
 /**********************************************************************
  * Print the pipeline state (useful for debugging)
@@ -90,10 +275,10 @@ void pipe_print_state(Pipeline *p){
         }
     }
     printf("\n");
-    for(width_i = 0; width_i < PIPE_WIDTH; width_i++) {
+    for(width_i = 0; width_i < p->cfg.width; width_i++) {
         for(latch_type_i = 0; latch_type_i < NUM_LATCH_TYPES; latch_type_i++) {
-            if(p->pipe_latch[latch_type_i][width_i].valid == true) {
-	      printf(" %6u ",(uint32_t)( p->pipe_latch[latch_type_i][width_i].op_id));
+            if(p->pipe_latch[latch_type_i].valid[width_i] == true) {
+	      printf(" %6u ",(uint32_t)( p->pipe_latch[latch_type_i].op_id[width_i]));
             } else {
                 printf(" ------ ");
             }
@@ -105,12 +290,40 @@ void pipe_print_state(Pipeline *p){
 }
 
 
+/**********************************************************************
+ * Nothing in flight and fetch waiting out a redirect / BTB bubble: the
+ * only thing left to change is the time. The latches still move empty
+ * slots' stale ops and ID stalls around for a cycle or two, so
+ * pipe_cycle() only skips ahead once a cycle changes nothing.
+ **********************************************************************/
+
+static bool pipe_idle(const Pipeline *p){
+    if(p->fetch_cbr_stall || p->stat_num_cycle + 2 >= p->fetch_resume_cycle) {
+      return false;
+    }
+    int width = p->cfg.width;
+    for(int latch = 0; latch < NUM_LATCH_TYPES; latch++) {
+      for(int ii = 0; ii < width; ii++) {
+        if(p->pipe_latch[latch].valid[ii]) {
+          return false;
+        }
+      }
+    }
+    return true;
+}
+
+
 /**********************************************************************
  * Pipeline Main Function: Every cycle, cycle the stage 
  **********************************************************************/
 
 void pipe_cycle(Pipeline *p)
 {
+    bool idle = pipe_idle(p);
+    if(idle) {
+      memcpy(p->idle_latch, p->pipe_latch, sizeof(p->pipe_latch));
+    }
+
     p->stat_num_cycle++;
 
     pipe_cycle_WB(p);
@@ -118,6 +331,19 @@ void pipe_cycle(Pipeline *p)
     pipe_cycle_EX(p);
     pipe_cycle_ID(p);
     pipe_cycle_FE(p);
+
+    // a cycle that left everything as it was repeats until fetch resumes:
+    // jump to the last one (or the driver's limit), the next pipe_cycle()
+    // fetches
+    if(idle && !memcmp(p->idle_latch, p->pipe_latch, sizeof(p->pipe_latch))) {
+      uint64_t last_idle = p->fetch_resume_cycle - 1;
+      if(last_idle > p->skip_limit) {
+        last_idle = p->skip_limit;
+      }
+      if(last_idle > p->stat_num_cycle) {
+        p->stat_num_cycle = last_idle;
+      }
+    }
 }
 /**********************************************************************
  * -----------  DO NOT MODIFY THE CODE ABOVE THIS LINE ----------------
@@ -125,16 +351,20 @@ void pipe_cycle(Pipeline *p)
 
 void pipe_cycle_WB(Pipeline *p){
   int ii;
-  for(ii=0; ii<PIPE_WIDTH; ii++){
-    if(p->pipe_latch[MEM_LATCH][ii].valid){
+  int width = p->cfg.width;
+  Pipeline_Latch *mem = &p->pipe_latch[MEM_LATCH];
+  if(p->b_pred && !p->cfg.bpred_instant){
+    pipe_train_bpred(p);
+  }
+  if(!p->cfg.resolve_ex){
+    pipe_resolve_cbr(p, MEM_LATCH);
+  }
+  for(ii=0; ii<width; ii++){
+    if(mem->valid[ii]){
 		p->stat_retired_inst++;
-		if(p->pipe_latch[MEM_LATCH][ii].op_id >= p->halt_op_id){
+		if(mem->op_id[ii] >= p->halt_op_id){
 			p->halt=true;
 		}
-		if(p->fetch_cbr_stall && p->pipe_latch[MEM_LATCH][ii].is_mispred_cbr)
-		{
-			p->fetch_cbr_stall = false;
-		}
 	}
   }
 }
@@ -143,8 +373,17 @@ void pipe_cycle_WB(Pipeline *p){
 
 void pipe_cycle_MEM(Pipeline *p){
   int ii;
-  for(ii=0; ii<PIPE_WIDTH; ii++){
-    p->pipe_latch[MEM_LATCH][ii]=p->pipe_latch[EX_LATCH][ii];
+  int width = p->cfg.width;
+  Pipeline_Latch *mem = &p->pipe_latch[MEM_LATCH];
+  Pipeline_Latch *ex = &p->pipe_latch[EX_LATCH];
+  // branches leaving EX resolve a stage early
+  if(p->cfg.resolve_ex){
+    pipe_resolve_cbr(p, EX_LATCH);
+  }
+  for(ii=0; ii<width; ii++){
+    mem->op_id[ii] = ex->op_id[ii];
+    mem->valid[ii] = ex->valid[ii];
+    mem->stall[ii] = ex->stall[ii];
   }
 }
 
@@ -152,141 +391,188 @@ void pipe_cycle_MEM(Pipeline *p){
 
 void pipe_cycle_EX(Pipeline *p){
   int ii;
-  for(ii=0; ii<PIPE_WIDTH; ii++){
-    p->pipe_latch[EX_LATCH][ii]=p->pipe_latch[ID_LATCH][ii];
-	if(p->pipe_latch[EX_LATCH][ii].stall)
+  int width = p->cfg.width;
+  Pipeline_Latch *ex = &p->pipe_latch[EX_LATCH];
+  Pipeline_Latch *id = &p->pipe_latch[ID_LATCH];
+  for(ii=0; ii<width; ii++){
+    ex->op_id[ii] = id->op_id[ii];
+    ex->stall[ii] = id->stall[ii];
+	if(id->stall[ii])
 	{
-		p->pipe_latch[EX_LATCH][ii].valid = false;
+		ex->valid[ii] = false;
 	}
 	else
 	{
-		p->pipe_latch[ID_LATCH][ii].valid = false;
+		ex->valid[ii] = id->valid[ii];
+		id->valid[ii] = false;
 	}
   }
 }
 
 //--------------------------------------------------------------------//
 
+/**********************************************************************
+ * Hazard helpers for the ID stage. Writers in EX / MEM are checked
+ * with the vector scan in pipe_hazard.h; ops in ID go into a table of
+ * the oldest writer per register, since only an older op in the same
+ * stage counts.
+ **********************************************************************/
+
+static inline void pipe_op_producer(Pipe_Producers *pp, const Trace_Rec *rec){
+  pipe_producers_add(pp, rec->dest, rec->dest_needed, rec->cc_write);
+}
+
+static inline void pipe_op_consumer(Pipe_Consumers *pc, const Trace_Rec *rec){
+  pipe_consumers_add(pc, rec->src1_reg, rec->src1_needed,
+                     rec->src2_reg, rec->src2_needed, rec->cc_read);
+}
+
+static inline void pipe_ages_add(Pipe_Writer_Ages *ages, const Trace_Rec *rec, uint64_t op_id){
+  if(rec->dest_needed && op_id < ages->regs[rec->dest]){
+    ages->regs[rec->dest] = op_id;
+  }
+  if(rec->cc_write && op_id < ages->cc){
+    ages->cc = op_id;
+  }
+}
+
+// undo pipe_ages_add for every op added since the table was empty
+static inline void pipe_ages_clear(Pipe_Writer_Ages *ages, const Trace_Rec *rec){
+  ages->regs[rec->dest] = PIPE_NO_WRITER;
+  ages->cc = PIPE_NO_WRITER;
+}
+
+static inline bool pipe_ages_hazard(const Pipe_Writer_Ages *ages, const Trace_Rec *rec, uint64_t op_id){
+  return (rec->src1_needed && ages->regs[rec->src1_reg] < op_id)
+      || (rec->src2_needed && ages->regs[rec->src2_reg] < op_id)
+      || (rec->cc_read && ages->cc < op_id);
+}
+
+//--------------------------------------------------------------------//
+
 void pipe_cycle_ID(Pipeline *p){
-int ii;
-  for(ii=0; ii<2*PIPE_WIDTH; ii++){
-    if(!p->pipe_latch[ID_LATCH][ii].stall && ii<PIPE_WIDTH)
-	{
-		p->pipe_latch[ID_LATCH][ii]=p->pipe_latch[FE_LATCH][ii];
-	}
-    if(ENABLE_MEM_FWD & ENABLE_EXE_FWD)
-	{
-		p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = false;
-		for(int jj=0; jj<PIPE_WIDTH; jj++)
-		{
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_needed && p->pipe_latch[EX_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[EX_LATCH][jj].valid && p->pipe_latch[EX_LATCH][jj].tr_entry.op_type == OP_LD)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_reg == p->pipe_latch[EX_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_needed && p->pipe_latch[EX_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[EX_LATCH][jj].valid && p->pipe_latch[EX_LATCH][jj].tr_entry.op_type == OP_LD)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_reg == p->pipe_latch[EX_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.cc_read && p->pipe_latch[EX_LATCH][jj].tr_entry.cc_write && p->pipe_latch[EX_LATCH][jj].valid && p->pipe_latch[EX_LATCH][jj].tr_entry.op_type == OP_LD)
-			{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}		
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_needed && p->pipe_latch[ID_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_reg == p->pipe_latch[ID_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_needed && p->pipe_latch[ID_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_reg == p->pipe_latch[ID_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.cc_read && p->pipe_latch[ID_LATCH][jj].tr_entry.cc_write && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id && p->pipe_latch[ID_LATCH][jj].stall)
-			{
-				p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}
-		}
+  // Each slot stalls on a source written by an op still in EX (only
+  // loads with forwarding) or MEM (no forwarding), or by an older op
+  // in ID, and behind any older stalled op in ID. With only one of the
+  // forwarding paths on, the lab model checks no hazards at all.
+  //
+  // The lab model decides twice per cycle: first slot by slot as the
+  // FE ops are copied in (slots above the current one still hold last
+  // cycle's ops and stalls), then again over the full stage, where
+  // slots above the current one still show their first-pass stall.
+  // Both passes are kept so results match, but each is O(W): hazards
+  // on EX / MEM come from one vector scan (the ops a slot holds are the
+  // same in both passes), hazards in ID from the oldest-writer table,
+  // and "an older op stalls" is a compare against the oldest stalled
+  // op_id on either side of the slot.
+  Pipeline_Latch *id = &p->pipe_latch[ID_LATCH];
+  Pipeline_Latch *fe = &p->pipe_latch[FE_LATCH];
+  Pipe_Writer_Ages *ages = &p->id_ages;
+  bool fwd = p->cfg.mem_fwd && p->cfg.exe_fwd;
+  bool no_fwd = !p->cfg.mem_fwd && !p->cfg.exe_fwd;
+  int width = p->cfg.width;
+  int ii;
+
+  if(!fwd && !no_fwd){
+    for(ii=0; ii<width; ii++){
+      if(!id->stall[ii]){
+        id->op_id[ii] = fe->op_id[ii];
+        id->valid[ii] = fe->valid[ii];
+      }
     }
-	
-	if(!ENABLE_MEM_FWD & !ENABLE_EXE_FWD)
-	{
-		p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = false;
-		for(int jj=0; jj<PIPE_WIDTH; jj++)
-		{
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_needed && p->pipe_latch[EX_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[EX_LATCH][jj].valid)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_reg == p->pipe_latch[EX_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_needed && p->pipe_latch[EX_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[EX_LATCH][jj].valid)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_reg == p->pipe_latch[EX_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_needed && p->pipe_latch[MEM_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[MEM_LATCH][jj].valid)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_reg == p->pipe_latch[MEM_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_needed && p->pipe_latch[MEM_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[MEM_LATCH][jj].valid)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_reg == p->pipe_latch[MEM_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.cc_read && p->pipe_latch[EX_LATCH][jj].tr_entry.cc_write && p->pipe_latch[EX_LATCH][jj].valid)
-			{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.cc_read && p->pipe_latch[MEM_LATCH][jj].tr_entry.cc_write && p->pipe_latch[MEM_LATCH][jj].valid)
-			{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}		
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_needed && p->pipe_latch[ID_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src1_reg == p->pipe_latch[ID_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_needed && p->pipe_latch[ID_LATCH][jj].tr_entry.dest_needed && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.src2_reg == p->pipe_latch[ID_LATCH][jj].tr_entry.dest)
-				{
-					p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-				}
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].tr_entry.cc_read && p->pipe_latch[ID_LATCH][jj].tr_entry.cc_write && p->pipe_latch[ID_LATCH][jj].valid && p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id)
-			{
-				p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}
-			if(p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].op_id > p->pipe_latch[ID_LATCH][jj].op_id && p->pipe_latch[ID_LATCH][jj].stall && p->pipe_latch[ID_LATCH][jj].valid)
-			{
-				p->pipe_latch[ID_LATCH][ii%PIPE_WIDTH].stall = true;
-			}
-		}
-	}
+    return;
+  }
+
+  // without forwarding a stalled op only holds back younger ones if it is valid
+  bool stall_needs_valid = no_fwd;
+
+  // the op each slot holds once FE has been copied in
+  uint64_t op_id[MAX_PIPE_WIDTH];
+  const Trace_Rec *rec[MAX_PIPE_WIDTH];
+  for(ii=0; ii<width; ii++){
+    op_id[ii] = id->stall[ii] ? id->op_id[ii] : fe->op_id[ii];
+    rec[ii] = pipe_op_rec(p, op_id[ii]);
+  }
+
+  Pipe_Producers stage;
+  Pipe_Consumers decode;
+  pipe_producers_init(&stage);
+  pipe_consumers_init(&decode);
+  for(ii=0; ii<width; ii++){
+    const Pipeline_Latch *ex = &p->pipe_latch[EX_LATCH];
+    const Pipeline_Latch *mem = &p->pipe_latch[MEM_LATCH];
+    if(ex->valid[ii]){
+      const Trace_Rec *ex_rec = pipe_op_rec(p, ex->op_id[ii]);
+      if(no_fwd || ex_rec->op_type == OP_LD){
+        pipe_op_producer(&stage, ex_rec);
+      }
+    }
+    if(mem->valid[ii] && no_fwd){
+      pipe_op_producer(&stage, pipe_op_rec(p, mem->op_id[ii]));
+    }
+    pipe_op_consumer(&decode, rec[ii]);
+  }
+  uint64_t stage_hazards = pipe_hazard_scan(&stage, &decode);
+
+  bool hazard[MAX_PIPE_WIDTH];        // EX / MEM, or an older op above the slot in pass 1
+  uint64_t above[MAX_PIPE_WIDTH];     // oldest stalled op above the slot, pass 1
+  uint64_t oldest;
+
+  // pass 1, slots above: last cycle's ops and stalls
+  oldest = PIPE_NO_WRITER;
+  for(ii=width-1; ii>=0; ii--){
+    const Trace_Rec *last = pipe_op_rec(p, id->op_id[ii]);
+    hazard[ii] = ((stage_hazards >> ii) & 1) || pipe_ages_hazard(ages, rec[ii], op_id[ii]);
+    above[ii] = oldest;
+    if(id->valid[ii]){
+      pipe_ages_add(ages, last, id->op_id[ii]);
+    }
+    if(id->stall[ii] && (id->valid[ii] || !stall_needs_valid) && id->op_id[ii] < oldest){
+      oldest = id->op_id[ii];
+    }
+  }
+  for(ii=0; ii<width; ii++){
+    pipe_ages_clear(ages, pipe_op_rec(p, id->op_id[ii]));
+  }
+
+  for(ii=0; ii<width; ii++){
+    if(!id->stall[ii]){
+      id->op_id[ii] = fe->op_id[ii];
+      id->valid[ii] = fe->valid[ii];
+    }
+  }
+
+  // pass 1, slots below: this cycle's ops and first-pass stalls
+  bool stall1[MAX_PIPE_WIDTH];
+  oldest = PIPE_NO_WRITER;
+  for(ii=0; ii<width; ii++){
+    stall1[ii] = hazard[ii] || pipe_ages_hazard(ages, rec[ii], op_id[ii])
+              || op_id[ii] > oldest || op_id[ii] > above[ii];
+    if(id->valid[ii]){
+      pipe_ages_add(ages, rec[ii], op_id[ii]);
+    }
+    if(stall1[ii] && (id->valid[ii] || !stall_needs_valid) && op_id[ii] < oldest){
+      oldest = op_id[ii];
+    }
+  }
+
+  // pass 2: the whole stage; above the slot still holds pass 1 stalls
+  for(ii=width-1, oldest=PIPE_NO_WRITER; ii>=0; ii--){
+    above[ii] = oldest;
+    if(stall1[ii] && (id->valid[ii] || !stall_needs_valid) && op_id[ii] < oldest){
+      oldest = op_id[ii];
+    }
+  }
+  oldest = PIPE_NO_WRITER;
+  for(ii=0; ii<width; ii++){
+    id->stall[ii] = ((stage_hazards >> ii) & 1) || pipe_ages_hazard(ages, rec[ii], op_id[ii])
+                 || op_id[ii] > oldest || op_id[ii] > above[ii];
+    if(id->stall[ii] && (id->valid[ii] || !stall_needs_valid) && op_id[ii] < oldest){
+      oldest = op_id[ii];
+    }
+  }
+  for(ii=0; ii<width; ii++){
+    pipe_ages_clear(ages, rec[ii]);
   }
 }
 
@@ -294,25 +580,29 @@ int ii;
 
 void pipe_cycle_FE(Pipeline *p){
   int ii;
-  Pipeline_Latch fetch_op;
-  bool tr_read_success;
-
-  for(ii=0; ii<PIPE_WIDTH; ii++){
-    if(!p->pipe_latch[ID_LATCH][ii].stall && !p->fetch_cbr_stall)
+  int width = p->cfg.width;
+  Pipeline_Latch *fe = &p->pipe_latch[FE_LATCH];
+
+  for(ii=0; ii<width; ii++){
+    // a slot that fetches nothing still names the last op fetched
+    bool fetched = false;
+    if(!p->pipe_latch[ID_LATCH].stall[ii] && !p->fetch_cbr_stall
+       && p->stat_num_cycle >= p->fetch_resume_cycle)
 	{
-		pipe_get_fetch_op(p, &fetch_op);
-	}
-	else
-	{
-		fetch_op.valid = false;
+		fetched = pipe_get_fetch_op(p);
 	}
 	
-    if(BPRED_POLICY){
-      pipe_check_bpred(p, &fetch_op);
+    if(p->b_pred && fetched){
+      pipe_check_bpred(p, p->fetch_op_id);
+    }
+    if(p->btb && fetched){
+      pipe_check_btb(p, p->fetch_op_id);
     }
     
-    // copy the op in FE LATCH
-	p->pipe_latch[FE_LATCH][ii]=fetch_op;
+    // name the op in FE LATCH
+	fe->op_id[ii] = p->fetch_op_id;
+	fe->valid[ii] = fetched;
+	fe->stall[ii] = false;
   }
   
 }
@@ -320,19 +610,35 @@ void pipe_cycle_FE(Pipeline *p){
 
 //--------------------------------------------------------------------//
 
-void pipe_check_bpred(Pipeline *p, Pipeline_Latch *fetch_op){
-  // call branch predictor here, if mispred then mark in fetch_op
+void pipe_check_bpred(Pipeline *p, uint64_t op_id){
+  // call branch predictor here, if mispred then mark the op
   // update the predictor instantly
   // stall fetch using the flag p->fetch_cbr_stall
   
-  static BPRED Predictor(BPRED_POLICY);
-  if(fetch_op->tr_entry.op_type == OP_CBR && fetch_op->valid)
+  uint64_t slot = op_id & p->window.mask;
+  const Trace_Rec *rec = &p->window.rec[slot];
+  if(rec->op_type == OP_CBR)
   {
 	  p->b_pred->stat_num_branches++;
-	  if (Predictor.GetPrediction(fetch_op->tr_entry.inst_addr) != fetch_op->tr_entry.br_dir)
+	  bool pred_dir;
+	  if(p->cfg.bpred_instant)
+	  {
+		  pred_dir = p->b_pred->GetPrediction(rec->inst_addr);
+		  p->b_pred->UpdatePredictor(rec->inst_addr, rec->br_dir, pred_dir);
+	  }
+	  else
+	  {
+		  // history moves on speculatively; training waits for WB
+		  pred_dir = p->b_pred->PredictSpeculative(rec->inst_addr, &p->window.bpred_hist[slot]);
+	  }
+	  if(pred_dir)
+	  {
+		  p->window.flags[slot] |= PIPE_OP_PRED_DIR;
+	  }
+	  if (pred_dir != rec->br_dir)
 	  {
 		  p->b_pred->stat_num_mispred++;
-		  fetch_op->is_mispred_cbr = true;
+		  p->window.flags[slot] |= PIPE_OP_MISPRED;
 		  p->fetch_cbr_stall = true;
 	  }
   }
@@ -341,3 +647,118 @@ void pipe_check_bpred(Pipeline *p, Pipeline_Latch *fetch_op){
 
 //--------------------------------------------------------------------//
 
+void pipe_check_btb(Pipeline *p, uint64_t op_id){
+  // a taken branch needs its target at fetch. A direction mispredict
+  // is redirected with the target from execute, so only branches
+  // correctly predicted taken look it up; on a miss the target comes
+  // from decode, the rest of the fetch group is dropped and fetch
+  // idles btb_penalty cycles
+
+  const Trace_Rec *rec = pipe_op_rec(p, op_id);
+  if((pipe_op_flags(p, op_id) & PIPE_OP_MISPRED) || !rec->br_dir)
+  {
+	  return;
+  }
+
+  uint64_t addr = rec->inst_addr;
+  uint64_t target = rec->br_target;
+  uint64_t ret;
+  bool hit;
+  switch(pipe_branch_kind(rec))
+  {
+	  case BR_COND:
+		  hit = p->btb->Lookup(addr, target);
+		  break;
+	  case BR_CALL:
+		  ras_push(&p->ras, addr + RAS_CALL_BYTES);
+		  hit = p->btb->Lookup(addr, target);
+		  break;
+	  case BR_RETURN:
+		  p->ras.stat_num_returns++;
+		  hit = ras_pop(&p->ras, &ret) && ret == target;
+		  if(!hit)
+		  {
+			  p->ras.stat_num_mispred++;
+		  }
+		  break;
+	  default:
+		  return;
+  }
+
+  if(!hit)
+  {
+	  p->fetch_resume_cycle = p->stat_num_cycle + 1 + p->cfg.btb_penalty;
+	  p->stat_btb_bubbles += p->cfg.btb_penalty;
+  }
+}
+
+
+//--------------------------------------------------------------------//
+
+void pipe_resolve_cbr(Pipeline *p, Latch_Type latch){
+  // branches in latch have their outcome now: write taken targets to
+  // the BTB, and on a mispredict repair the history and restart fetch
+  // after redirect_penalty cycles (fetch has been stalled since the
+  // mispredict, so nothing younger is in flight)
+  int ii;
+  int width = p->cfg.width;
+  const Pipeline_Latch *l = &p->pipe_latch[latch];
+  for(ii=0; ii<width; ii++){
+    if(!l->valid[ii]){
+      continue;
+    }
+    uint64_t slot = l->op_id[ii] & p->window.mask;
+    const Trace_Rec *rec = &p->window.rec[slot];
+    if(rec->op_type != OP_CBR){
+      continue;
+    }
+    if(p->btb && rec->br_dir){
+      p->btb->Update(rec->inst_addr, rec->br_target);
+    }
+    if(!(p->window.flags[slot] & PIPE_OP_MISPRED)){
+      continue;
+    }
+    if(p->b_pred && !p->cfg.bpred_instant){
+      p->b_pred->Repair(p->window.bpred_hist[slot], rec->br_dir);
+    }
+    p->fetch_cbr_stall = false;
+    if(p->cfg.redirect_penalty){
+      p->fetch_resume_cycle = p->stat_num_cycle + p->cfg.redirect_penalty;
+      p->stat_redirect_bubbles += p->cfg.redirect_penalty;
+    }
+  }
+}
+
+
+//--------------------------------------------------------------------//
+
+void pipe_train_bpred(Pipeline *p){
+  // branches leaving MEM retire now: train each with the history it
+  // was predicted with, oldest first
+  const Pipeline_Latch *mem = &p->pipe_latch[MEM_LATCH];
+  uint64_t cbr[MAX_PIPE_WIDTH];
+  int num_cbr = 0;
+  int ii, jj;
+  int width = p->cfg.width;
+
+  for(ii=0; ii<width; ii++){
+    uint64_t op_id = mem->op_id[ii];
+    if(mem->valid[ii] && pipe_op_rec(p, op_id)->op_type == OP_CBR){
+      for(jj=num_cbr; jj>0 && cbr[jj-1] > op_id; jj--){
+        cbr[jj] = cbr[jj-1];
+      }
+      cbr[jj] = op_id;
+      num_cbr++;
+    }
+  }
+
+  for(ii=0; ii<num_cbr; ii++){
+    uint64_t slot = cbr[ii] & p->window.mask;
+    const Trace_Rec *rec = &p->window.rec[slot];
+    p->b_pred->Train(rec->inst_addr, p->window.bpred_hist[slot], rec->br_dir,
+                     p->window.flags[slot] & PIPE_OP_PRED_DIR);
+  }
+}
+
+
+//--------------------------------------------------------------------//
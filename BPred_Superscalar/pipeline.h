@@ -7,8 +7,10 @@
 
 #include "trace.h"
 #include "bpred.h"
+#include "btb.h"
 
-#define MAX_PIPE_WIDTH 8
+#define MAX_PIPE_WIDTH 32
+#define NUM_REGS       256         // Trace_Rec register fields are uint8_t
 
 
 /*********************************************************************
@@ -16,15 +18,59 @@
 **********************************************************************/
 
 
-/* Pipeline Latches */
+/* Pipeline configuration: everything a run is set up with, so any
+   number of pipelines can run side by side (see bpred.h for BPRED_Config) */
+typedef struct Pipe_Config_Struct {
+  uint32_t width;                 // 1..MAX_PIPE_WIDTH
+  bool mem_fwd;                   // forwarding from MEM
+  bool exe_fwd;                   // forwarding from EX
+  uint32_t bpred_policy;          // 0: perfect, else a BPRED_TYPE
+  BPRED_Config bpred;
+  bool bpred_instant;             // train at fetch, no speculative history
+  uint32_t btb_entries;           // 0: every taken target is known at fetch
+  uint32_t btb_ways;
+  uint32_t btb_penalty;           // fetch bubbles after a BTB miss
+  bool resolve_ex;                // mispredicts redirect fetch from EX, not WB
+  uint32_t redirect_penalty;      // fetch bubbles after a mispredict resolves
+} Pipe_Config;
+
+void pipe_config_init(Pipe_Config *cfg);                      // lab defaults: 1 wide, no forwarding, perfect bpred
+bool pipe_config_check(const Pipe_Config *cfg, const char **why);
+
+
+/* Trace window: every op in flight, by op_id. Ops are written once at
+   fetch and the latches only name them, so moving an op down the pipe
+   copies an op_id and two flags. A ring, grown if a latch still names
+   an op the next fetch would overwrite. op_id 0 is the empty op. */
+#define PIPE_WINDOW_SIZE 256      // initial entries, a power of 2
+
+#define PIPE_OP_MISPRED   0x1     // OP_CBR mispredicted at fetch
+#define PIPE_OP_PRED_DIR  0x2     // OP_CBR predicted taken
+
+typedef struct Pipe_Window_Struct {
+  Trace_Rec *rec;
+  uint64_t  *bpred_hist;          // OP_CBR: global history it was predicted with
+  uint8_t   *flags;               // PIPE_OP_*
+  uint64_t   mask;                // entries - 1
+  uint64_t   oldest;              // no latch names an op before this one
+} Pipe_Window;
+
+/* Pipeline Latches: one stage's slots, as arrays */
 typedef struct Pipeline_Latch_Struct {
-  bool valid;
-  uint64_t op_id;
-  bool stall;
-  Trace_Rec tr_entry;
-  bool is_mispred_cbr; 
+  uint64_t op_id[MAX_PIPE_WIDTH]; // op in the window (stale if not valid)
+  bool valid[MAX_PIPE_WIDTH];
+  bool stall[MAX_PIPE_WIDTH];
 }Pipeline_Latch;
 
+/* Oldest writer of each register among a set of ID ops, so "is an
+   older op in decode writing my source" is one compare */
+typedef struct Pipe_Writer_Ages_Struct {
+  uint64_t regs[NUM_REGS];        // op_id, PIPE_NO_WRITER if none
+  uint64_t cc;
+} Pipe_Writer_Ages;
+
+#define PIPE_NO_WRITER ((uint64_t)-1)
+
 typedef enum Latch_Type_ENUM {
     FE_LATCH,
     ID_LATCH,
@@ -35,22 +81,37 @@ typedef enum Latch_Type_ENUM {
 
 
 typedef struct Pipeline {
-  FILE *tr_file;
-  Pipeline_Latch  pipe_latch[NUM_LATCH_TYPES][MAX_PIPE_WIDTH];// Pipeline Latches
+  Pipe_Config cfg;
+  Trace_Reader *tr_reader;
+  Trace_Prefetcher<Trace_Rec> *tr_prefetch;  // optional decode thread, else NULL
+  Pipeline_Latch  pipe_latch[NUM_LATCH_TYPES];  // Pipeline Latches
+  Pipe_Window window;
+  Pipe_Writer_Ages id_ages;        // scratch for pipe_cycle_ID, empty between calls
+  Pipeline_Latch  idle_latch[NUM_LATCH_TYPES];  // scratch for pipe_cycle, latches before an idle cycle
   BPRED *b_pred;
+  BTB *btb;                       // NULL: every taken target is known at fetch
+  RAS ras;
   
   uint64_t op_id_tracker;         // a sequence number for OPs to track
   uint64_t halt_op_id;            // OpID of last inst in Trace
+  uint64_t max_op_id;             // fetch treats ops past this as end of trace (-max)
   bool halt;                      // Pipeline Done Flag
 
+  uint64_t fetch_op_id;           // last op fetched, left in slots that fetch nothing
   bool fetch_cbr_stall;           // fetch stalled due to brach misprediction
+  uint64_t fetch_resume_cycle;    // fetch idle before this cycle (redirect / BTB bubbles)
+  uint64_t skip_limit;            // pipe_cycle never skips idle cycles past this one
   
   /* Statistics: students need to update these counters*/
   uint64_t stat_retired_inst;         // Total Commited Instructions
   uint64_t stat_num_cycle;            // Total Cycles
+  uint64_t stat_btb_bubbles;          // fetch cycles lost to BTB misses
+  uint64_t stat_redirect_bubbles;     // fetch cycles lost to the redirect penalty
 }Pipeline;
 
-Pipeline* pipe_init(FILE *tr_file);   // Allocate Structures
+Pipeline* pipe_init(const Pipe_Config *cfg, Trace_Reader *tr_reader,
+                    Trace_Prefetcher<Trace_Rec> *tr_prefetch);   // Allocate Structures
+void pipe_free(Pipeline *p);                        // ... and release them
 
 void pipe_cycle(Pipeline *p);                        // Runs one Pipeline Cycle
 void pipe_cycle_FE(Pipeline *p);                    // Fetch Stage 
@@ -59,8 +120,25 @@ void pipe_cycle_EX(Pipeline *p);                    // EX Stage
 void pipe_cycle_MEM(Pipeline *p);                   // MEM Stage 
 void pipe_cycle_WB(Pipeline *p);                    // WB Stage
 
-void pipe_check_bpred(Pipeline *p, Pipeline_Latch *fetch_op); // Branch Prediction Check
+void pipe_check_bpred(Pipeline *p, uint64_t op_id);  // Branch Prediction Check
+void pipe_check_btb(Pipeline *p, uint64_t op_id);    // Target Prediction Check
+void pipe_resolve_cbr(Pipeline *p, Latch_Type latch); // Redirect fetch after mispredicts in latch
+void pipe_train_bpred(Pipeline *p);                  // Train on branches retiring this cycle
 
 void pipe_print_state(Pipeline *p);                 // Print Pipeline Latches
 
+uint64_t pipe_warm(Pipeline *p, uint64_t num_inst);  // Functional fast-forward, returns insts skipped
+uint64_t pipe_seek(Pipeline *p, uint64_t num_inst);  // Skip insts with no warming, returns insts skipped
+void pipe_resume(Pipeline *p, uint64_t num_inst);    // Restart a halted pipeline for num_inst more insts
+
+/* The window entry of an op; op_id 0 is all zeroes */
+static inline const Trace_Rec* pipe_op_rec(const Pipeline *p, uint64_t op_id){
+  static const Trace_Rec empty = Trace_Rec();
+  return op_id ? &p->window.rec[op_id & p->window.mask] : &empty;
+}
+
+static inline uint8_t pipe_op_flags(const Pipeline *p, uint64_t op_id){
+  return op_id ? p->window.flags[op_id & p->window.mask] : 0;
+}
+
 #endif
@@ -10,6 +10,8 @@
 #include <assert.h>
 
 #include "pipeline.h"
+#include "trace_simpoint.h"
+#include "trace_sample.h"
 
 #define HEARTBEAT_CYCLES 10000
 
@@ -26,25 +28,63 @@ void die_message(const char *msg) {
 void die_usage() {
     printf("Usage : sim [options] <trace_file> \n\n");
     printf("Trace driven pipeline simulator\n");
+    printf("<trace_file> may be gzip'd or raw; use - (or omit it) for stdin\n");
     printf("Options\n");
-    printf("   -pipewidth   <num>    Set width of pipeline to <num> (Default: 1)\n");
+    printf("   -pipewidth   <num>    Set width of pipeline to <num>, up to 32 (Default: 1)\n");
     printf("   -enablememfwd         Enable forwarding from MEM stage (Default: off)\n");
     printf("   -enableexefwd         Enable forwarding from EXE stage (Default: off)\n");
-    printf("   -bpredpolicy <num>    Set branch predictor  [0:Perf 1:Taken 2:Gshare]\n");
+    printf("   -bpredpolicy <num>    Set branch predictor  [0:Perf 1:Taken 2:Gshare 3:Bimodal\n");
+    printf("                                                 4:Tournament 5:TAGE 6:Perceptron]\n");
+    bpred_config_usage();
+    printf("   -bpredinstant         Train the predictor at fetch, with no history repair (Default: off)\n");
+    printf("   -btb         <num>    BTB entries, 0 for targets always known at fetch (Default: 0)\n");
+    printf("   -btbways     <num>    BTB associativity (Default: 4)\n");
+    printf("   -btbpenalty  <num>    Fetch bubbles after a BTB miss (Default: 1)\n");
+    printf("   -resolveex            Resolve branches leaving EX instead of at WB (Default: off)\n");
+    printf("   -redirectpenalty <num> Fetch bubbles after a mispredict resolves (Default: 0)\n");
+    printf("   -prefetch             Decode the trace on a separate thread (Default: off)\n");
+    printf("   -skip        <num>    Fast-forward <num> insts, warming the predictor only (Default: 0)\n");
+    printf("   -max         <num>    Simulate at most <num> insts in detail (Default: all)\n");
+    printf("   -simpoints   <file>   Simulate only the intervals in <file> (see trace_profile)\n");
+    printf("   -warmup      <num>    Warm the predictor <num> insts before each simpoint (Default: 1 interval)\n");
+    printf("   -sample      <num>    Sample the trace in windows of <num> insts (Default: off)\n");
+    printf("   -samplewarm  <num>    Detailed warmup before each window (Default: %d)\n", TRACE_SAMPLE_WARM);
+    printf("   -period      <num>    Window spacing in the first pass (Default: trace / %d)\n", TRACE_SAMPLE_MIN);
+    printf("   -error       <pct>    Stop once the CPI is within <pct>%% (Default: %g)\n", 100 * TRACE_SAMPLE_TARGET);
+    printf("   -confidence  <pct>    ... at <pct>%% confidence (Default: %g)\n", 100 * TRACE_SAMPLE_CONFIDENCE);
 }
 
 void check_heartbeat(void);
 
+bool copy_trace_rec(const Trace_Rec *tr_entry, Trace_Rec *out) {
+    *out = *tr_entry;
+    return true;
+}
+
 void print_stats(void);
+void run_simpoints(Trace_Simpoint_Set *sp);
+void run_sampled(Trace_Reader *tr_reader);
 
 
 /*********************************************************************
  * Params and Globals
  *********************************************************************/
-uint32_t  PIPE_WIDTH=1;
-uint32_t  ENABLE_MEM_FWD=0;
-uint32_t  ENABLE_EXE_FWD=0;
-uint32_t  BPRED_POLICY=0; // 0:Perf 1:AlwaysTaken 2:Gshare
+Pipe_Config PIPE_CONFIG;           // the pipeline keeps its own copy
+uint32_t  TRACE_PREFETCH=0;
+uint64_t  SKIP_INST=0;
+uint64_t  MAX_INST=0;     // 0: no limit
+char     *SIMPOINT_FILE=NULL;
+uint64_t  WARMUP_INST=(uint64_t)-1;  // -1: one interval
+
+uint32_t  SIMPOINT_COUNT=0;          // simpoints simulated
+double    SIMPOINT_CPI=0;            // their weighted CPI
+
+uint64_t  SAMPLE_UNIT=0;             // 0: no sampling
+uint64_t  SAMPLE_WARM=TRACE_SAMPLE_WARM;
+uint64_t  SAMPLE_PERIOD=0;           // 0: pick from the trace length
+double    SAMPLE_ERROR=100*TRACE_SAMPLE_TARGET;
+double    SAMPLE_CONFIDENCE=100*TRACE_SAMPLE_CONFIDENCE;
+Trace_Sampler SAMPLER;
 
 Pipeline *pipeline;
 /*********************************************************************
@@ -55,13 +95,11 @@ int main(int argc, char *argv[])
 {
   int ii;
 
-    FILE *tr_file;
-    char tr_filename[1024];
-    char cmd_string[256];
-    
-    if(argc < 1) {
-        die_message("Must Provide a Trace File"); 
-    }
+    Trace_Reader *tr_reader;
+    Trace_Prefetcher<Trace_Rec> *tr_prefetch = NULL;
+    char tr_filename[1024] = "-";
+
+    pipe_config_init(&PIPE_CONFIG);
 
     //--------------------------------------------------------------------
     // -- Get params from command line 
@@ -75,24 +113,131 @@ int main(int argc, char *argv[])
 
 	    else if (!strcmp(argv[ii], "-pipewidth")) {
 		if (ii < argc - 1) {		  
-		    PIPE_WIDTH = atoi(argv[ii+1]);
+		    PIPE_CONFIG.width = atoi(argv[ii+1]);
 		    ii += 1;
 		}
 	    }
 
 	    else if (!strcmp(argv[ii], "-bpredpolicy")) {
 		if (ii < argc - 1) {		  
-		    BPRED_POLICY = atoi(argv[ii+1]);
+		    PIPE_CONFIG.bpred_policy = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (ii < argc - 1 && bpred_config_arg(&PIPE_CONFIG.bpred, argv[ii], argv[ii+1])) {
+		ii += 1;
+	    }
+
+	    else if (!strcmp(argv[ii], "-bpredinstant")) {
+	      PIPE_CONFIG.bpred_instant = true;
+	    }
+
+	    else if (!strcmp(argv[ii], "-btb")) {
+		if (ii < argc - 1) {		  
+		    PIPE_CONFIG.btb_entries = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-btbways")) {
+		if (ii < argc - 1) {		  
+		    PIPE_CONFIG.btb_ways = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-btbpenalty")) {
+		if (ii < argc - 1) {		  
+		    PIPE_CONFIG.btb_penalty = atoi(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-resolveex")) {
+	      PIPE_CONFIG.resolve_ex = true;
+	    }
+
+	    else if (!strcmp(argv[ii], "-redirectpenalty")) {
+		if (ii < argc - 1) {		  
+		    PIPE_CONFIG.redirect_penalty = atoi(argv[ii+1]);
 		    ii += 1;
 		}
 	    }
 
 	    else if (!strcmp(argv[ii], "-enablememfwd")) {
-	      ENABLE_MEM_FWD = 1;
+	      PIPE_CONFIG.mem_fwd = true;
 	    }
 
 	    else if (!strcmp(argv[ii], "-enableexefwd")) {
-	      ENABLE_EXE_FWD = 1;
+	      PIPE_CONFIG.exe_fwd = true;
+	    }
+
+	    else if (!strcmp(argv[ii], "-prefetch")) {
+	      TRACE_PREFETCH = 1;
+	    }
+
+	    else if (!strcmp(argv[ii], "-skip")) {
+		if (ii < argc - 1) {		  
+		    SKIP_INST = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-max")) {
+		if (ii < argc - 1) {		  
+		    MAX_INST = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-simpoints")) {
+		if (ii < argc - 1) {		  
+		    SIMPOINT_FILE = argv[ii+1];
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-warmup")) {
+		if (ii < argc - 1) {		  
+		    WARMUP_INST = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-sample")) {
+		if (ii < argc - 1) {		  
+		    SAMPLE_UNIT = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-samplewarm")) {
+		if (ii < argc - 1) {		  
+		    SAMPLE_WARM = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-period")) {
+		if (ii < argc - 1) {		  
+		    SAMPLE_PERIOD = strtoull(argv[ii+1], NULL, 10);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-error")) {
+		if (ii < argc - 1) {		  
+		    SAMPLE_ERROR = atof(argv[ii+1]);
+		    ii += 1;
+		}
+	    }
+
+	    else if (!strcmp(argv[ii], "-confidence")) {
+		if (ii < argc - 1) {		  
+		    SAMPLE_CONFIDENCE = atof(argv[ii+1]);
+		    ii += 1;
+		}
 	    }
 	}
 	else {
@@ -100,31 +245,177 @@ int main(int argc, char *argv[])
 	}
     }
 
+
+    const char *config_why;
+    if (!pipe_config_check(&PIPE_CONFIG, &config_why)) {
+        die_message(config_why);
+    }
+
+    Trace_Simpoint_Set *simpoints = NULL;
+    if (SIMPOINT_FILE) {
+        if (SKIP_INST || MAX_INST) {
+            die_message("-simpoints cannot be combined with -skip or -max");
+        }
+        if ((simpoints = trace_simpoints_read(SIMPOINT_FILE)) == NULL) {
+            die_message("Unable to read the simpoint file");
+        }
+    }
+    if (SAMPLE_UNIT) {
+        if (SIMPOINT_FILE || SKIP_INST || MAX_INST || TRACE_PREFETCH) {
+            die_message("-sample cannot be combined with -simpoints, -skip, -max or -prefetch");
+        }
+        if (SAMPLE_CONFIDENCE <= 0 || SAMPLE_CONFIDENCE >= 100) {
+            die_message("-confidence must be between 0 and 100");
+        }
+    }
     
   // ------- Open Trace File -------------------------------------------
-    sprintf(cmd_string,"gunzip -c %s", tr_filename);
-    if ((tr_file = popen(cmd_string, "r")) == NULL){
-        printf("Command string is %s\n", cmd_string);
-        die_message("Unable to open the trace file with gzip option \n")  ;
+    if ((tr_reader = trace_open(tr_filename)) == NULL){
+        printf("Trace file is %s\n", tr_filename);
+        die_message("Unable to open the trace file")  ;
     } else {
-        printf("Opened file with command: %s \n", cmd_string);
+        printf("Opened trace file: %s \n", tr_filename);
+    }
+     
+    if (TRACE_PREFETCH){
+        tr_prefetch = new Trace_Prefetcher<Trace_Rec>(tr_reader, copy_trace_rec);
     }
      
   // ------- Pipeline Initialization & Execution ----------------------
 
-     pipeline = pipe_init(tr_file); 
-    
-    while(!pipeline->halt) {
-      pipe_cycle(pipeline);
-      check_heartbeat();
+     pipeline = pipe_init(&PIPE_CONFIG, tr_reader, tr_prefetch); 
+     pipeline->skip_limit = HEARTBEAT_CYCLES;     // idle skips stop at each heartbeat
+     if(MAX_INST){
+       pipeline->max_op_id = MAX_INST;
+     }
+     if(SKIP_INST){
+       SKIP_INST = pipe_warm(pipeline, SKIP_INST);
+     }
+
+    if(simpoints){
+      run_simpoints(simpoints);
+      trace_simpoints_free(simpoints);
+    } else if(SAMPLE_UNIT){
+      run_sampled(tr_reader);
+    } else {
+      while(!pipeline->halt) {
+        pipe_cycle(pipeline);
+        check_heartbeat();
+      }
     }
 
   // ------- Print Statistics------------------------------------------
     print_stats();
-    fclose(tr_file);
+    pipe_free(pipeline);
+    delete tr_prefetch;
+    trace_close(tr_reader);
     return 0;
 }
 
+/*********************************************************************
+ * SimPoint Run: for each point, skip up to WARMUP_INST insts short of
+ * it, warm the predictor over the rest of the gap, then simulate the
+ * interval in detail on a drained pipeline. The whole-run CPI estimate
+ * is the weighted mean of the interval CPIs.
+ *********************************************************************/
+
+void run_simpoints(Trace_Simpoint_Set *sp) {
+    uint64_t len = sp->interval_len;
+    uint64_t warmup = (WARMUP_INST == (uint64_t)-1) ? len : WARMUP_INST;
+    uint64_t pos = 0;                   // next trace record
+    double weight_sum = 0;
+
+    for (uint32_t ii = 0; ii < sp->num_points; ii++) {
+      uint64_t start = sp->points[ii].interval * len;
+      uint64_t gap = start - pos;
+      uint64_t warm = (gap < warmup) ? gap : warmup;
+
+      pos += pipe_seek(pipeline, gap - warm);
+      pos += pipe_warm(pipeline, warm);
+      if (pos < start) {
+        printf("\nSimPoint interval %" PRIu64 " is past the end of the trace\n", sp->points[ii].interval);
+        break;
+      }
+
+      uint64_t inst0 = pipeline->stat_retired_inst;
+      uint64_t cycle0 = pipeline->stat_num_cycle;
+      pipe_resume(pipeline, len);
+      while(!pipeline->halt) {
+        pipe_cycle(pipeline);
+        check_heartbeat();
+      }
+      uint64_t num_inst = pipeline->stat_retired_inst - inst0;
+      uint64_t num_cycle = pipeline->stat_num_cycle - cycle0;
+      pos += num_inst;
+      if (num_inst == 0) {
+        break;
+      }
+
+      double cpi = (double)num_cycle / (double)num_inst;
+      printf("\nSimPoint %2u: interval %8" PRIu64 "  weight %.4f  CPI %6.3f", ii,
+             sp->points[ii].interval, sp->points[ii].weight, cpi);
+      SIMPOINT_CPI += sp->points[ii].weight * cpi;
+      weight_sum += sp->points[ii].weight;
+      SIMPOINT_COUNT++;
+    }
+
+    // points past the end of the trace drop out of the average
+    if (weight_sum > 0) {
+      SIMPOINT_CPI /= weight_sum;
+    }
+}
+
+/*********************************************************************
+ * Sampled Run: functional fast-forward (warming the predictor) to each
+ * window, SAMPLE_WARM insts of detailed warmup, then SAMPLE_UNIT insts
+ * measured. When a pass runs off the end of the trace without reaching
+ * the target error, rewind for the next, denser pass.
+ *********************************************************************/
+
+void run_sampled(Trace_Reader *tr_reader) {
+    trace_sampler_init(&SAMPLER, SAMPLE_UNIT, SAMPLE_WARM, SAMPLE_PERIOD, tr_reader->num_recs,
+                       SAMPLE_ERROR / 100, SAMPLE_CONFIDENCE / 100);
+    uint64_t window = SAMPLER.warm + SAMPLER.unit;
+    uint64_t pos = 0;                   // next trace record
+
+    for (;;) {
+      uint64_t start = SAMPLER.next;
+      pos += pipe_warm(pipeline, start - pos);
+
+      if (pos == start) {
+        uint64_t inst0 = pipeline->stat_retired_inst;
+        uint64_t mark_inst = inst0;
+        uint64_t mark_cycle = pipeline->stat_num_cycle;
+        pipe_resume(pipeline, window);
+        while(!pipeline->halt) {
+          pipe_cycle(pipeline);
+          check_heartbeat();
+          // measure from the first cycle that retires past the warmup
+          if (mark_inst == inst0 && SAMPLER.warm && pipeline->stat_retired_inst - inst0 >= SAMPLER.warm) {
+            mark_inst = pipeline->stat_retired_inst;
+            mark_cycle = pipeline->stat_num_cycle;
+          }
+        }
+        pos += pipeline->stat_retired_inst - inst0;
+
+        if (pipeline->stat_retired_inst - inst0 == window && pipeline->stat_retired_inst > mark_inst) {
+          trace_sampler_add(&SAMPLER, (double)(pipeline->stat_num_cycle - mark_cycle)
+                                    / (double)(pipeline->stat_retired_inst - mark_inst));
+          if (trace_sampler_done(&SAMPLER)) {
+            break;
+          }
+          continue;
+        }
+      }
+
+      // off the end of the trace
+      if (!trace_sampler_next_pass(&SAMPLER) || !trace_seek(tr_reader, 0)) {
+        break;
+      }
+      pos = 0;
+    }
+}
+
 /*********************************************************************
  * Print Statistics 
  *********************************************************************/
@@ -134,7 +425,8 @@ void print_stats(void) {
     sprintf(header, "LAB2");
     uint64_t stat_num_inst       = pipeline->stat_retired_inst;
     uint64_t stat_num_cycle      = pipeline->stat_num_cycle;
-    double cpi = (double)(stat_num_cycle)/(double)(stat_num_inst);
+    // 0 when nothing retired, e.g. -skip ran past the end of the trace
+    double cpi = stat_num_inst ? (double)(stat_num_cycle)/(double)(stat_num_inst) : 0;
 
     printf("\n\n");
   
@@ -142,10 +434,43 @@ void print_stats(void) {
     printf("\n%s_NUM_CYCLES         \t : %10u" , header, (uint32_t)stat_num_cycle);
     printf("\n%s_CPI                \t : %10.3f" , header, cpi);
 
-    if(BPRED_POLICY){
+    if(SKIP_INST){
+    printf("\n%s_SKIPPED_INST       \t : %10u" , header, (uint32_t)SKIP_INST)  ;
+    }
+
+    if(SIMPOINT_FILE){
+    printf("\n%s_SIMPOINTS          \t : %10u" , header, SIMPOINT_COUNT)  ;
+    printf("\n%s_WEIGHTED_CPI       \t : %10.3f" , header, SIMPOINT_CPI);
+    }
+
+    if(SAMPLE_UNIT){
+    printf("\n%s_SAMPLES            \t : %10u" , header, (uint32_t)SAMPLER.n)  ;
+    printf("\n%s_SAMPLE_PASSES      \t : %10u" , header, SAMPLER.pass + 1)  ;
+    printf("\n%s_SAMPLED_CPI        \t : %10.3f" , header, SAMPLER.mean);
+    printf("\n%s_CPI_ERROR_PCT      \t : %10.3f" , header, 100.0*trace_sampler_error(&SAMPLER));
+    printf("\n%s_CONFIDENCE_PCT     \t : %10.3f" , header, SAMPLE_CONFIDENCE);
+    }
+
+    if(pipeline->b_pred){
     printf("\n%s_BPRED_BRANCHES     \t : %10u" , header, (uint32_t)pipeline->b_pred->stat_num_branches)  ;
     printf("\n%s_BPRED_MISPRED      \t : %10u" , header, (uint32_t)pipeline->b_pred->stat_num_mispred)  ;
-    printf("\n%s_MISPRED_RATE       \t : %10.3f" , header, 100.0*(double)(pipeline->b_pred->stat_num_mispred)/(double)(pipeline->b_pred->stat_num_branches));
+    printf("\n%s_MISPRED_RATE       \t : %10.3f" , header, pipeline->b_pred->stat_num_branches ? 100.0*(double)(pipeline->b_pred->stat_num_mispred)/(double)(pipeline->b_pred->stat_num_branches) : 0);
+    }
+
+    if(pipeline->cfg.redirect_penalty){
+    printf("\n%s_REDIRECT_BUBBLES   \t : %10u" , header, (uint32_t)pipeline->stat_redirect_bubbles)  ;
+    }
+
+    if(pipeline->btb){
+    printf("\n%s_BTB_LOOKUPS        \t : %10u" , header, (uint32_t)pipeline->btb->stat_num_lookups)  ;
+    printf("\n%s_BTB_MISSES         \t : %10u" , header, (uint32_t)pipeline->btb->stat_num_misses)  ;
+    printf("\n%s_BTB_MISS_RATE      \t : %10.3f" , header, pipeline->btb->stat_num_lookups ? 100.0*(double)(pipeline->btb->stat_num_misses)/(double)(pipeline->btb->stat_num_lookups) : 0);
+    printf("\n%s_BTB_BUBBLES        \t : %10u" , header, (uint32_t)pipeline->stat_btb_bubbles)  ;
+    }
+
+    if(pipeline->ras.stat_num_returns){
+    printf("\n%s_RAS_RETURNS        \t : %10u" , header, (uint32_t)pipeline->ras.stat_num_returns)  ;
+    printf("\n%s_RAS_MISPRED        \t : %10u" , header, (uint32_t)pipeline->ras.stat_num_mispred)  ;
     }
     
     printf("\n\n");
@@ -175,8 +500,14 @@ void check_heartbeat(void){
 
   last_hbeat_cycle=pipeline->stat_num_cycle;
   last_hbeat_inst = pipeline->stat_retired_inst;
+  pipeline->skip_limit = last_hbeat_cycle + HEARTBEAT_CYCLES;
 
   // print a newline and CPI every so often
+  if(pipeline->stat_num_cycle - last_hbeat_line >= 50*HEARTBEAT_CYCLES && SAMPLE_UNIT){
+    printf("\n(Samples:%6u\tCPI:%6.3f +-%6.2f%%)\t", (uint32_t)SAMPLER.n, SAMPLER.mean,
+	   100.0*trace_sampler_error(&SAMPLER));
+    last_hbeat_line=pipeline->stat_num_cycle;
+  }
   if(pipeline->stat_num_cycle - last_hbeat_line >= 50*HEARTBEAT_CYCLES){
     printf("\n(Inst:%8u\tCycle:%8u\tCPI:%6.3f)\t", (uint32_t)pipeline->stat_retired_inst,
 	   (uint32_t)pipeline->stat_num_cycle, (double)(pipeline->stat_num_cycle)/(double)(pipeline->stat_retired_inst+1));
@@ -1,45 +1,483 @@
 #include "procsim.hpp"
 
-proc_settings_t cpu;
+#include <algorithm>
+
+/**
+ * Fills in the default machine (see procsim.hpp), with no timestamp dump
+ */
+void proc_config_init(proc_config_t* cfg) {
+    cfg->r = DEFAULT_R;
+    cfg->k0 = DEFAULT_K0;
+    cfg->k1 = DEFAULT_K1;
+    cfg->k2 = DEFAULT_K2;
+    cfg->f = DEFAULT_F;
+    cfg->begin_dump = 0;
+    cfg->end_dump = 0;
+    cfg->rob_size = 0;
+    cfg->commit_width = 0;
+    cfg->bpred_policy = BPRED_PERFECT;
+    bpred_config_init(&cfg->bpred);
+    cfg->redirect_penalty = 0;
+    cfg->lq_size = 0;
+    cfg->sq_size = 0;
+    cfg->memdep = PROC_MEMDEP_CONSERVATIVE;
+    cfg->violation_penalty = DEFAULT_VIOLATION_PENALTY;
+}
+
+/**
+ * Checks the options the lab machine does not have; why says what is wrong
+ */
+bool proc_config_check(const proc_config_t* cfg, const char** why) {
+    const char* err = NULL;
+    if (cfg->commit_width > 0 && cfg->rob_size == 0) {
+        err = "a commit width needs a ROB";
+    } else if (cfg->redirect_penalty > 0 && cfg->bpred_policy == BPRED_PERFECT) {
+        err = "a redirect penalty needs a branch predictor";
+    } else if ((cfg->lq_size == 0) != (cfg->sq_size == 0)) {
+        err = "a load queue needs a store queue and the other way round";
+    } else if (cfg->memdep >= NUM_PROC_MEMDEP) {
+        err = "unknown memory dependence policy";
+    } else if (cfg->memdep != PROC_MEMDEP_CONSERVATIVE && cfg->lq_size == 0) {
+        err = "a memory dependence policy needs load and store queues";
+    } else {
+        bpred_config_check(cfg->bpred_policy, &cfg->bpred, &err);
+    }
+
+    if (why)
+        *why = err;
+    return err == NULL;
+}
 
-std::vector<proc_inst_ptr_t> all_instrs;
 
-std::deque<proc_inst_ptr_t> dispatching_queue;
-std::vector<proc_inst_ptr_t> scheduling_queue;
-int scheduling_queue_limit;
+/**
+ * Posts a cycle at which some stage has work. Any change to the machine
+ * posts the next cycle, as every stage reads what the others left; a
+ * unit that takes longer would post the cycle it finishes instead, and
+ * run_proc skips the cycles in between.
+ */
+static inline void post_event(proc_t* proc, uint64_t cycle) {
+    if (cycle < proc->cpu.next_event)
+        proc->cpu.next_event = cycle;
+}
+
+/**
+ * Makes room in the window for instruction id, growing the ring if the
+ * oldest one not retired is too far back
+ */
+static void window_reserve(proc_window_t* w, uint64_t id) {
+    if (id - w->oldest <= w->mask)
+        return;
 
-std::unordered_map<uint32_t, register_info_t> register_file;
+    uint64_t entries = w->mask + 1;
+    while (id - w->oldest > entries - 1)
+        entries *= 2;
 
-std::vector<proc_cdb_t> cdb;
-std::unordered_map<uint32_t, uint32_t> fu_cnt;
+    std::vector<proc_inst_t> grown(entries);
+    for (uint64_t i = w->oldest; i < id; i++)
+        grown[i & (entries - 1)] = w->insts[i & w->mask];
+    w->insts.swap(grown);
+    w->mask = entries - 1;
+}
+
+/**
+ * The dispatch queue's record of an instruction fetch just read
+ */
+static proc_fetched_t pack_fetched(const proc_inst_t* read, uint64_t cycle) {
+    proc_fetched_t fetched;
+    fetched.cycle_fetch_decode = cycle;
+    fetched.mem_addr = read->mem_addr;
+    fetched.instruction_address = read->instruction_address;
+    fetched.dest_reg = read->dest_reg;
+    fetched.src_reg[0] = read->src_reg[0];
+    fetched.src_reg[1] = read->src_reg[1];
+    fetched.op_code = read->op_code;
+    fetched.branch = read->branch;
+    fetched.br_taken = read->br_taken;
+    fetched.load = read->load;
+    fetched.store = read->store;
+    fetched.mispredicted = false;
+    fetched.reserved = false;
+    if (fetched.branch)
+        fetched.bpred_hist = 0;
+    return fetched;
+}
 
+/**
+ * Expands a dispatching instruction into its window entry as instruction id
+ */
+static void unpack_fetched(const proc_fetched_t* fetched, uint64_t id, proc_inst_t* instr) {
+    *instr = proc_inst_t();
+    instr->id = id;
+    instr->instruction_address = fetched->instruction_address;
+    instr->op_code = fetched->op_code;
+    instr->dest_reg = fetched->dest_reg;
+    instr->src_reg[0] = fetched->src_reg[0];
+    instr->src_reg[1] = fetched->src_reg[1];
+    instr->branch = fetched->branch;
+    instr->br_taken = fetched->br_taken;
+    instr->load = fetched->load;
+    instr->store = fetched->store;
+    instr->mispredicted = fetched->mispredicted;
+    if (instr->branch)
+        instr->bpred_hist = fetched->bpred_hist;
+    else
+        instr->mem_addr = fetched->mem_addr;
+    instr->reserved = true;
+    instr->cycle_fetch_decode = fetched->cycle_fetch_decode;
+    instr->cycle_dispatch = fetched->cycle_fetch_decode + 1;
+}
+
+/**
+ * The lab model's "all_instrs[tag]" readiness check names the
+ * instruction after tag's writer: it counts once that one has a state
+ * update cycle, which everything already gone from the window has
+ */
+static inline bool status_updated(proc_t* proc, uint64_t id) {
+    return id < proc->window.oldest || proc_inst(proc, id)->cycle_status_update > 0;
+}
+
+/**
+ * Both sources ready: the instruction can fire once a FU of its type is free
+ */
+static inline bool sources_ready(const proc_inst_t* instr) {
+    return (instr->src_reg[0] < 0 || instr->src_ready[0]) && (instr->src_reg[1] < 0 || instr->src_ready[1])
+        && !instr->mem_wait;
+}
+
+/**
+ * A CDB line, busy or not, still holding tag's result. Lines keep their
+ * last broadcast until execute grants them again, and the lab model
+ * matches against every one of them
+ */
+static bool cdb_holds(proc_t* proc, uint64_t tag, int32_t reg) {
+    for(unsigned j = 0; j < proc->cdb.size(); j++){
+        if(proc->cdb[j].tag == tag && proc->cdb[j].reg == (unsigned)reg)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Lowest free CDB line, or -1 if all are busy
+ */
+static inline int cdb_first_free(proc_t* proc) {
+    for(unsigned w = 0; w < proc->cdb_free.size(); w++){
+        if(proc->cdb_free[w])
+            return w * 64 + __builtin_ctzll(proc->cdb_free[w]);
+    }
+    return -1;
+}
+
+/**
+ * Readies every source waiting on tag. A waiting source can only become
+ * ready when tag's writer is granted a line (it broadcasts tag) or the
+ * instruction after it updates state (status_updated), so the list
+ * lives on that instruction, and whichever comes first empties it
+ */
+static void wake_tag(proc_t* proc, proc_stats_t* p_stats, uint64_t tag) {
+    // nothing waits if it is not dispatched yet, or its slot went to a later
+    // one; it may have retired this cycle, but dispatch only reuses slots after
+    uint64_t next_id = tag + 1;
+    if (next_id >= proc->rob_tail)
+        return;
+    proc_inst_t* next = proc_inst(proc, next_id);
+    if (next->id != next_id)
+        return;
+
+    uint64_t w = next->waiters;
+    next->waiters = 0;
+    while (w) {
+        proc_inst_t* instr = proc_inst(proc, w >> 1);
+        int k = w & 1;
+        w = instr->next_waiter[k];
+        instr->src_ready[k] = true; //Mark source register as true, so as to facilitate firing in next cycle
+        post_event(proc, p_stats->cycle_count + 1);
+        if (sources_ready(instr))
+            proc->ready[instr->op_code].push(instr->id);
+    }
+}
+
+/**
+ * The store set of the load or store at addr
+ */
+static inline uint32_t& store_set(proc_t* proc, uint32_t addr) {
+    return proc->store_sets[addr % PROC_SSIT_SIZE];
+}
+
+/**
+ * The older store load may not fire ahead of under the memory dependence
+ * policy, 0 if none. Stores have their data once granted a result bus.
+ */
+static uint32_t mem_blocker(proc_t* proc, const proc_inst_t* load) {
+    uint32_t set = 0;
+    if (proc->memdep == PROC_MEMDEP_STORE_SETS && !(set = store_set(proc, load->instruction_address)))
+        return 0;
+
+    for(auto it = proc->store_queue.rbegin(); it != proc->store_queue.rend(); it++){
+        proc_inst_t* store = proc_inst(proc, *it);
+        if (store->id > load->id || store->retired)
+            continue;
+        if (proc->memdep == PROC_MEMDEP_CONSERVATIVE) {
+            if (!store->executed)
+                return store->id;
+        } else if (proc->memdep == PROC_MEMDEP_PERFECT ? store->mem_addr == load->mem_addr
+                                                       : store_set(proc, store->instruction_address) == set) {
+            return store->executed ? 0 : store->id;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Holds load back until store executes
+ */
+static inline void mem_wait_on(proc_t* proc, proc_inst_t* load, uint32_t store_id) {
+    proc_inst_t* store = proc_inst(proc, store_id);
+    load->mem_wait = store_id;
+    load->next_mem_waiter = store->mem_waiters;
+    store->mem_waiters = load->id;
+}
+
+/**
+ * A load no longer held back: it checks the policy again, under which it
+ * may now wait on another store
+ */
+static void mem_release(proc_t* proc, proc_inst_t* load) {
+    uint32_t blocker = mem_blocker(proc, load);
+    if (blocker)
+        mem_wait_on(proc, load, blocker);
+    else if (sources_ready(load))
+        proc->ready[load->op_code].push(load->id);
+}
+
+/**
+ * A store has executed: the loads waiting on it are released, except
+ * those that fired ahead of it, which fire again once the violation
+ * penalty is paid
+ */
+static void wake_store(proc_t* proc, proc_stats_t* p_stats, uint32_t store_id) {
+    proc_inst_t* store = proc_inst(proc, store_id);
+    uint32_t id = store->mem_waiters;
+    store->mem_waiters = 0;
+    while (id) {
+        proc_inst_t* load = proc_inst(proc, id);
+        id = load->next_mem_waiter;
+        load->mem_wait = 0;
+        post_event(proc, p_stats->cycle_count + 1);
+        if (load->fire) {
+            load->fire = load->fired = false;
+            uint64_t refire = p_stats->cycle_count + 1 + proc->violation_penalty;
+            proc->replays.push_back(std::make_pair(refire, load->id));
+            post_event(proc, refire - 1);
+        } else {
+            mem_release(proc, load);
+        }
+    }
+}
+
+/**
+ * A load fires: it reads the youngest older store to its address, or
+ * memory. Under store sets that store may not have executed yet. Then the
+ * load has fired too early: it gives its FU back without a result and
+ * waits on the store (see store_executed), so nothing reads the stale
+ * value. The trace has the address up front, so the violation is caught
+ * here rather than when a real machine's store would find it.
+ *
+ * @return false if the store was granted a line this cycle: like a
+ *         register result, its data is there next cycle, and the load
+ *         waits for it without firing, as under the other policies
+ */
+static bool load_fired(proc_t* proc, proc_stats_t* p_stats, proc_inst_t* load) {
+    for(auto it = proc->store_queue.rbegin(); it != proc->store_queue.rend(); it++){
+        proc_inst_t* store = proc_inst(proc, *it);
+        if (store->id < load->id && !store->retired && store->mem_addr == load->mem_addr) {
+            if (store->executed && store->cycle_status_update) {
+                p_stats->forwarded_loads++;
+                return true;
+            }
+            mem_wait_on(proc, load, store->id);
+            return !store->executed;
+        }
+    }
+    return true;
+}
+
+/**
+ * A store executed: wake the loads held back on it. Those that already
+ * fired are ordering violations; the load and store are put in one store
+ * set, and the load fires again -violationpenalty cycles later, with its
+ * dependents behind it.
+ */
+static void store_executed(proc_t* proc, proc_stats_t* p_stats, proc_inst_t* store) {
+    proc->woken_stores.push_back(store->id);
+    if (proc->memdep != PROC_MEMDEP_STORE_SETS)
+        return;
+
+    for(uint32_t id = store->mem_waiters; id; id = proc_inst(proc, id)->next_mem_waiter){
+        proc_inst_t* load = proc_inst(proc, id);
+        if (!load->fire)
+            continue;
+
+        p_stats->ordering_violations++;
+        uint32_t& load_set = store_set(proc, load->instruction_address);
+        uint32_t& store_set_id = store_set(proc, store->instruction_address);
+        if (!load_set && !store_set_id)
+            load_set = store_set_id = ++proc->next_store_set;
+        else if (!load_set)
+            load_set = store_set_id;
+        else if (!store_set_id)
+            store_set_id = load_set;
+        else
+            load_set = store_set_id = std::min(load_set, store_set_id);
+    }
+}
+
+/**
+ * Takes instr out of the machine: with no ROB as soon as it updates
+ * state, else when it reaches the head of the ROB
+ */
+static void retire(proc_t* proc, proc_stats_t* p_stats, proc_inst_t* instr) {
+    // the dump range is kept, the slot is free once all older ones are
+    if(instr->id >= proc->cpu.begin_dump && instr->id <= proc->cpu.end_dump && proc->cpu.begin_dump > 0)
+        proc->dumped.push_back(*instr);
+    instr->retired = true;
+    while(proc->window.oldest < proc->rob_tail && proc_inst(proc, proc->window.oldest)->retired)
+        proc->window.oldest++;
+
+    if (proc->lq_size > 0 && instr->load) {
+        proc->lq_used--;
+        while (!proc->load_queue.empty() && proc_inst(proc, proc->load_queue.front())->retired)
+            proc->load_queue.pop_front();
+    }
+    if (proc->lq_size > 0 && instr->store) {
+        proc->sq_used--;
+        while (!proc->store_queue.empty() && proc_inst(proc, proc->store_queue.front())->retired)
+            proc->store_queue.pop_front();
+    }
+
+    p_stats->retired_instruction++;
+    post_event(proc, p_stats->cycle_count + 1);
+}
+
+/**
+ * Dispatch is waiting on the ROB to commit
+ */
+static inline bool rob_full(proc_t* proc) {
+    return proc->rob_size > 0 && proc->rob_tail - proc->rob_head == proc->rob_size
+        && !proc->dispatching_queue.empty();
+}
+
+/**
+ * Room for this many more instructions in the scheduling queue and ROB
+ */
+static inline uint64_t dispatch_room(proc_t* proc) {
+    uint64_t room = proc->scheduling_queue.free.size();
+    if (proc->rob_size > 0)
+        room = std::min(room, proc->rob_size - (proc->rob_tail - proc->rob_head));
+    return room;
+}
+
+/**
+ * The predictor is made on first use and kept by the proc_t, so each
+ * sample window and simpoint starts with what earlier ones and the
+ * fast-forward between them trained it on
+ */
+static void make_bpred(proc_t* proc, const proc_config_t* cfg) {
+    if (!proc->bpred && cfg->bpred_policy != BPRED_PERFECT)
+        proc->bpred.reset(new BPRED(cfg->bpred_policy, cfg->bpred));
+}
+
+/**
+ * Trains the branch predictor on an instruction fast-forwarded past, as
+ * sim's pipe_warm does. Nothing else outlives setup_proc, so there is
+ * nothing else to warm.
+ *
+ * @proc The processor, before or between setup_proc calls
+ * @inst A decoded trace instruction
+ */
+void warm_proc(proc_t* proc, const proc_config_t* cfg, const proc_inst_t* inst) {
+    make_bpred(proc, cfg);
+    if (inst->branch && proc->bpred) {
+        bool pred_dir = proc->bpred->GetPrediction(inst->instruction_address);
+        proc->bpred->UpdatePredictor(inst->instruction_address, inst->br_taken, pred_dir);
+    }
+}
 
 /**
  * Subroutine for initializing the processor. You many add and initialize any global or heap
  * variables as needed.
  * XXX: You're responsible for completing this routine
  *
- * @r Number of r result buses
- * @k0 Number of k0 FUs
- * @k1 Number of k1 FUs
- * @k2 Number of k2 FUs
- * @f Number of instructions to fetch
+ * @proc The processor to set up
+ * @cfg Number of result buses, FUs of each type and instructions to fetch
+ * @read Where fetch reads instructions from, called with read_arg
  */
-void setup_proc(proc_stats_t *p_stats, uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f, uint64_t begin_dump, uint64_t end_dump) {
+void setup_proc(proc_t* proc, const proc_config_t* cfg, proc_read_fn read, void* read_arg, proc_stats_t* p_stats) {
     p_stats->retired_instruction = 0;
     p_stats->cycle_count = 1;
 
-    cpu = proc_settings_t(f, begin_dump, end_dump);
+    proc->cpu = proc_settings_t(cfg->f, cfg->begin_dump, cfg->end_dump);
+    proc->read_instruction = read;
+    proc->read_arg = read_arg;
+
+    // start from an empty machine, setup_proc runs once per simpoint
+    proc->window.insts.assign(PROC_WINDOW_SIZE, proc_inst_t());
+    proc->window.mask = PROC_WINDOW_SIZE - 1;
+    proc->window.oldest = 1;
+    proc->dumped.clear();
+    proc->dispatching_queue.clear();
+    proc->scheduling_queue.slots.clear();
+    proc->scheduling_queue.free.clear();
+    proc->register_file.clear();
+    proc->cdb.clear();
+    proc->dispatched.clear();
+    proc->woken_tags.clear();
+    for(int t = 0; t < PROC_FU_TYPES; t++)
+        proc->ready[t] = proc_id_heap_t();
+    proc->firing.clear();
+    proc->fired.clear();
+    proc->waiting_cdb = proc_id_heap_t();
+    proc->completing.clear();
+    proc->updated.clear();
 
     for(int i = 0; i < 64; i++){
-        register_file[i] = {true};    
+        proc->register_file[i] = {true};    
     }
 
-    scheduling_queue_limit = 2 * (k0 + k1 + k2);
-    cdb.resize(r, {true});
-    fu_cnt[0] = k0;
-    fu_cnt[1] = k1;
-    fu_cnt[2] = k2;
+    proc->scheduling_queue_limit = 2 * (cfg->k0 + cfg->k1 + cfg->k2);
+    proc->scheduling_queue.slots.assign(proc->scheduling_queue_limit, 0);
+    for(int i = proc->scheduling_queue_limit - 1; i >= 0; i--)
+        proc->scheduling_queue.free.push_back(i);
+    proc->cdb.resize(cfg->r, {true});
+    proc->cdb_free.assign((cfg->r + 63) / 64, 0);
+    for(uint64_t j = 0; j < cfg->r; j++)
+        proc->cdb_free[j / 64] |= 1ull << (j % 64);
+    proc->fu_cnt[0] = cfg->k0;
+    proc->fu_cnt[1] = cfg->k1;
+    proc->fu_cnt[2] = cfg->k2;
+
+    proc->rob_size = cfg->rob_size;
+    proc->commit_width = cfg->commit_width;
+    proc->rob_head = 1;
+    proc->rob_tail = 1;
+
+    make_bpred(proc, cfg);
+    proc->redirect_penalty = cfg->redirect_penalty;
+    proc->fetch_branch = 0;
+    proc->fetch_resume = 0;
+
+    proc->lq_size = cfg->lq_size;
+    proc->sq_size = cfg->sq_size;
+    proc->memdep = cfg->memdep;
+    proc->violation_penalty = cfg->violation_penalty;
+    proc->load_queue.clear();
+    proc->store_queue.clear();
+    proc->lq_used = 0;
+    proc->sq_used = 0;
+    proc->store_sets.assign(PROC_SSIT_SIZE, 0);
+    proc->next_store_set = 0;
+    proc->woken_stores.clear();
+    proc->replays.clear();
 }
 
 /**
@@ -61,240 +499,375 @@ void complete_proc(proc_stats_t *p_stats) {
  *
  * @p_stats Pointer to the statistics structure
  */
-void run_proc(proc_stats_t* p_stats) {   
-    while (!cpu.finished) {
+void run_proc(proc_t* proc, proc_stats_t* p_stats) {   
+    while (!proc->cpu.finished) {
         // invoke pipeline for current cycle
-        state_update(p_stats, cycle_half_t::FIRST);
-        execute(p_stats, cycle_half_t::FIRST);
-        schedule(p_stats, cycle_half_t::FIRST);
-        dispatch(p_stats, cycle_half_t::FIRST);
-
-        state_update(p_stats, cycle_half_t::SECOND);
-
-        if (!cpu.finished){
-            execute(p_stats, cycle_half_t::SECOND);
-            schedule(p_stats, cycle_half_t::SECOND);
-            dispatch(p_stats, cycle_half_t::SECOND);
-            instr_fetch_and_decode(p_stats, cycle_half_t::SECOND);            
+        state_update(proc, p_stats, cycle_half_t::FIRST);
+        execute(proc, p_stats, cycle_half_t::FIRST);
+        schedule(proc, p_stats, cycle_half_t::FIRST);
+        dispatch(proc, p_stats, cycle_half_t::FIRST);
+
+        state_update(proc, p_stats, cycle_half_t::SECOND);
+
+        // end of warmup: the measured window starts after this cycle
+        if (p_stats->warmup_instruction && !p_stats->warmup_cycles
+            && p_stats->retired_instruction >= p_stats->warmup_instruction){
+            p_stats->warmup_retired = p_stats->retired_instruction;
+            p_stats->warmup_cycles = p_stats->cycle_count;
+        }
+
+        if (!proc->cpu.finished){
+            execute(proc, p_stats, cycle_half_t::SECOND);
+            schedule(proc, p_stats, cycle_half_t::SECOND);
+            dispatch(proc, p_stats, cycle_half_t::SECOND);
+            instr_fetch_and_decode(proc, p_stats, cycle_half_t::SECOND);            
         
             p_stats->cycle_count++;
+
+            // nothing posted for the next cycle: the cycles up to the next
+            // event would repeat this one, only the dispatch queue stats grow
+            if (proc->cpu.next_event > p_stats->cycle_count) {
+                if (proc->cpu.next_event == NEVER_CYCLE) {
+                    fprintf(stderr, "No stage has work at cycle %lu, the processor is deadlocked\n",
+                            p_stats->cycle_count);
+                    exit(1);
+                }
+                uint64_t idle = proc->cpu.next_event - p_stats->cycle_count;
+                p_stats->sum_disp_size += (double) idle * proc->dispatching_queue.size();
+                if (rob_full(proc))
+                    p_stats->rob_full_cycles += idle;
+                p_stats->cycle_count = proc->cpu.next_event;
+            }
+            proc->cpu.next_event = NEVER_CYCLE;
         }
     }
     
     // print result
-    if(cpu.begin_dump > 0){
+    if(proc->cpu.begin_dump > 0){
         std::cout << "INST\tFETCH\tDISP\tSCHED\tEXEC\tSTATE\tUNIT\tSRC1\tSRC2\tDEST" << std::endl;
 
-        for(unsigned i = 0; i < all_instrs.size(); i++){
-            auto instr = all_instrs[i];
-            if(instr->id >= cpu.begin_dump && instr->id <= cpu.end_dump){
-                std::cout << instr->id << "\t"
-                          << instr->cycle_fetch_decode << "\t" 
-                          << instr->cycle_dispatch << "\t"
-                          << instr->cycle_schedule << "\t"
-                          << instr->cycle_execute << "\t"
-                          << instr->cycle_status_update << "\t"
-						  << instr->op_code << "\t" //Displays Opcode for debugging purposes
-						  << instr->src_reg[0] << "\t" //Displays Source Register 1 for debugging purposes
-						  << instr->src_reg[1] << "\t" //Displays Source Register 2 for debugging purposes
-						  << instr->dest_reg << std::endl;  //Displays Destination Register for debugging purposes
-            }
+        // retired out of order
+        std::sort(proc->dumped.begin(), proc->dumped.end(),
+                  [](const proc_inst_t& a, const proc_inst_t& b) { return a.id < b.id; });
+        for(unsigned i = 0; i < proc->dumped.size(); i++){
+            const proc_inst_t* instr = &proc->dumped[i];
+            std::cout << instr->id << "\t"
+                      << instr->cycle_fetch_decode << "\t" 
+                      << instr->cycle_dispatch << "\t"
+                      << instr->cycle_schedule << "\t"
+                      << instr->cycle_execute << "\t"
+                      << instr->cycle_status_update << "\t"
+					  << instr->op_code << "\t" //Displays Opcode for debugging purposes
+					  << instr->src_reg[0] << "\t" //Displays Source Register 1 for debugging purposes
+					  << instr->src_reg[1] << "\t" //Displays Source Register 2 for debugging purposes
+					  << instr->dest_reg << std::endl;  //Displays Destination Register for debugging purposes
         }
         std::cout << std::endl;
     }
 }
 
 /** STATE UPDATE stage */
-void state_update(proc_stats_t* p_stats, const cycle_half_t &half) {
+void state_update(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half) {
     if (half == cycle_half_t::FIRST) {
-        // record instr entry cycle
-        for(unsigned i = 0; i < scheduling_queue.size(); i++){
-            auto instr = scheduling_queue[i];
-            if (instr->executed && !instr->cycle_status_update) {
-                instr->cycle_status_update = p_stats->cycle_count;
-				for(unsigned j = 0; j < cdb.size(); j++){ //Looping through all lines in the CDB
-					if(!cdb[j].free && cdb[j].tag == instr->id){ //Checking for a busy line and updating the register file destination ready bit
-						if(instr->dest_reg > -1 && register_file[instr->dest_reg].tag == cdb[j].tag){
-							register_file[instr->dest_reg].ready = true;
-						}
-						cdb[j].free = true; //Freeing busy line, simulating "write-back"
-					}
-				}
+        // record instr entry cycle, for everything granted a line last cycle
+        for(unsigned i = 0; i < proc->completing.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->completing[i]);
+            instr->cycle_status_update = p_stats->cycle_count;
+            post_event(proc, p_stats->cycle_count + 1);
+
+            //Updating the register file destination ready bit
+            if(instr->dest_reg > -1 && proc->register_file[instr->dest_reg].tag == instr->id){
+                proc->register_file[instr->dest_reg].ready = true;
             }
-        }        
+            proc->cdb[instr->cdb_line].free = true; //Freeing busy line, simulating "write-back"
+            proc->cdb_free[instr->cdb_line / 64] |= 1ull << (instr->cdb_line % 64);
+
+            proc->woken_tags.push_back(instr->id - 1);
+
+            // the branch's direction is known: train, and redirect fetch if it was wrong
+            if (instr->branch && proc->bpred) {
+                bool pred_dir = instr->br_taken != instr->mispredicted;
+                proc->bpred->Train(instr->instruction_address, instr->bpred_hist, instr->br_taken, pred_dir);
+                if (instr->mispredicted) {
+                    proc->bpred->Repair(instr->bpred_hist, instr->br_taken);
+                    proc->fetch_branch = 0;
+                    proc->fetch_resume = p_stats->cycle_count + 1 + proc->redirect_penalty;
+                    p_stats->mispredict_stall_cycles += proc->fetch_resume - (instr->cycle_fetch_decode + 1);
+                }
+            }
+        }
+        proc->updated.swap(proc->completing);
+        proc->completing.clear();
     } else {
         // delete instructions from scheduling queue
-        auto it = scheduling_queue.begin();
-        while(it != scheduling_queue.end()){
-            auto instr = *it;
-
-            if(instr->cycle_status_update){
-                it = scheduling_queue.erase(it);
-                p_stats->retired_instruction++;
-            }else{
-                it++;
+        for(unsigned i = 0; i < proc->updated.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->updated[i]);
+            proc->scheduling_queue.slots[instr->sched_slot] = 0;
+            proc->scheduling_queue.free.push_back(instr->sched_slot);
+            if (proc->rob_size == 0)
+                retire(proc, p_stats, instr);
+            else
+                post_event(proc, p_stats->cycle_count + 1);
+        }
+        proc->updated.clear();
+
+        // commit in order from the head of the ROB
+        if (proc->rob_size > 0) {
+            for(uint64_t n = 0; proc->commit_width == 0 || n < proc->commit_width; n++){
+                if (proc->rob_head == proc->rob_tail)
+                    break;
+                proc_inst_t* instr = proc_inst(proc, proc->rob_head);
+                if (!instr->cycle_status_update)
+                    break;
+                retire(proc, p_stats, instr);
+                proc->rob_head++;
             }
         }
         
-        if (cpu.read_finished && p_stats->retired_instruction == cpu.read_cnt) 
-            cpu.finished = true;        
+        if (proc->cpu.read_finished && p_stats->retired_instruction == proc->cpu.read_cnt) 
+            proc->cpu.finished = true;        
     }
 }
 
 /** EXECUTE stage */
-void execute(proc_stats_t* p_stats, const cycle_half_t &half) {
+void execute(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half) {
     if (half == cycle_half_t::FIRST) {
         // record instr entry cycle
-        for(unsigned i = 0; i < scheduling_queue.size(); i++){
-            auto instr = scheduling_queue[i];            
-            if (instr->fired == true && !instr->cycle_execute) {
-                instr->cycle_execute = p_stats->cycle_count;                  
-			}
-			if(!instr->executed && instr->fired){
-				for(unsigned j = 0; j < cdb.size(); j++){ //Looping through all lines in the CDB
-					if(cdb[j].free){ //Checking for a free line in the CDB for data "write-back"
-						cdb[j].reg = instr->dest_reg;
-						cdb[j].tag = instr->id;
-						cdb[j].free = false; //Setting line to busy
-						fu_cnt[instr->op_code]++; //Freeing the Functional Unit
-						instr->executed = true;
-						break;
-					}
-				}
-            }
+        for(unsigned i = 0; i < proc->fired.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->fired[i]);
+            instr->cycle_execute = p_stats->cycle_count;
+            if (instr->mem_wait)
+                proc->fu_cnt[instr->op_code]++;    // fired too early, no result
+            post_event(proc, p_stats->cycle_count + 1);
+        }
+        proc->fired.clear();
+
+        // oldest first, each takes the lowest free line for data "write-back"
+        while(!proc->waiting_cdb.empty()){
+            int j = cdb_first_free(proc);
+            if (j < 0)
+                break;
+            proc_inst_t* instr = proc_inst(proc, proc->waiting_cdb.top());
+            proc->waiting_cdb.pop();
+
+            proc->cdb[j].reg = instr->dest_reg;
+            proc->cdb[j].tag = instr->id;
+            proc->cdb[j].free = false; //Setting line to busy
+            proc->cdb_free[j / 64] &= ~(1ull << (j % 64));
+            proc->fu_cnt[instr->op_code]++; //Freeing the Functional Unit
+            instr->executed = true;
+            instr->cdb_line = j;
+            proc->completing.push_back(instr->id);
+            proc->woken_tags.push_back(instr->id);
+            if (proc->lq_size > 0 && instr->store)
+                store_executed(proc, p_stats, instr);
+            post_event(proc, p_stats->cycle_count + 1);
         }
     } else {
     }
 }
 
 /** SCHEDULE stage */
-void schedule(proc_stats_t* p_stats, const cycle_half_t &half) {
+void schedule(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half) {
     if (half == cycle_half_t::FIRST) {
         // record instr entry cycle
-        for(unsigned i = 0; i < scheduling_queue.size(); i++){
-            auto instr = scheduling_queue[i];            
-            if (instr->fire)
-                continue;
-            if(fu_cnt[instr->op_code] <= 0){ //Checking if there are any functional units available
-				instr->fire = false;
-			}
-			else if((instr->src_reg[0] > -1 && !instr->src_ready[0])||(instr->src_reg[1] > -1 && !instr->src_ready[1])){
-				//Checking if the source operands are ready or not
-				instr->fire = false;
-			}
-			else { //If neither, fire instruction
-				instr->fire = true;
-				fu_cnt[instr->op_code]--; //Reserve functional unit for fired instruction
-			}
-            if (!instr->cycle_schedule) {
-                instr->cycle_schedule = p_stats->cycle_count;                 
+        for(unsigned i = 0; i < proc->dispatched.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->dispatched[i]);
+            instr->cycle_schedule = p_stats->cycle_count;
+            post_event(proc, p_stats->cycle_count + 1);
+        }
+
+        // fire the oldest ready instructions while FUs of their type are available
+        for(int t = 0; t < PROC_FU_TYPES; t++){
+            uint32_t& free_fus = proc->fu_cnt[t];
+            while(free_fus > 0 && !proc->ready[t].empty()){
+                proc_inst_t* instr = proc_inst(proc, proc->ready[t].top());
+                proc->ready[t].pop();
+                if (proc->lq_size > 0 && instr->load && !load_fired(proc, p_stats, instr))
+                    continue;
+                instr->fire = true;
+                free_fus--; //Reserve functional unit for fired instruction
+                proc->firing.push_back(instr->id);
+                post_event(proc, p_stats->cycle_count + 1);
             }
-        } 
+        }
     } else {        
-        // fire all marked instructions if possible
-        for(unsigned i = 0; i < scheduling_queue.size(); i++){
-            auto instr = scheduling_queue[i];            
-            if (instr->fire && !instr->fired) {                
-                instr->fired = true;
+        // fire all marked instructions
+        for(unsigned i = 0; i < proc->firing.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->firing[i]);
+            instr->fired = true;
+            proc->fired.push_back(instr->id);
+            if (!instr->mem_wait)
+                proc->waiting_cdb.push(instr->id);
+            post_event(proc, p_stats->cycle_count + 1);
+        }
+        proc->firing.clear();
+
+        // loads held back on stores that executed this cycle
+        for(unsigned i = 0; i < proc->woken_stores.size(); i++){
+            wake_store(proc, p_stats, proc->woken_stores[i]);
+        }
+        proc->woken_stores.clear();
+
+        // loads that fired too early, due to fire again next cycle
+        while (!proc->replays.empty() && proc->replays.front().first <= p_stats->cycle_count + 1) {
+            mem_release(proc, proc_inst(proc, proc->replays.front().second));
+            proc->replays.pop_front();
+        }
+
+        // with no CDB lines nothing ever wakes
+        if (proc->cdb.empty()) {
+            proc->woken_tags.clear();
+            proc->dispatched.clear();
+            return;
+        }
+
+        // sources waiting on a tag broadcast or unblocked this cycle
+        for(unsigned i = 0; i < proc->woken_tags.size(); i++){
+            wake_tag(proc, p_stats, proc->woken_tags[i]);
+        }
+        proc->woken_tags.clear();
+
+        // the first check of newly dispatched instructions also sees older
+        // broadcasts still on the CDB; what is still not ready waits on a list
+        for(unsigned i = 0; i < proc->dispatched.size(); i++){
+            proc_inst_t* instr = proc_inst(proc, proc->dispatched[i]);
+            if (sources_ready(instr))
+                continue;   // already in a ready queue
+            bool waiting = false;
+            for(int k = 0; k < 2; k++){
+                if(instr->src_reg[k] < 0 || instr->src_ready[k])
+                    continue;
+                if(cdb_holds(proc, instr->src_tag[k], instr->src_reg[k]) || status_updated(proc, instr->src_tag[k] + 1)){
+                    instr->src_ready[k] = true;
+                    post_event(proc, p_stats->cycle_count + 1);
+                } else {
+                    proc_inst_t* next = proc_inst(proc, instr->src_tag[k] + 1);
+                    instr->next_waiter[k] = next->waiters;
+                    next->waiters = (uint64_t)instr->id << 1 | k;
+                    waiting = true;
+                }
             }
-			else { //If the instruction is not ready to be fired, check CDB lines for dependencies
-				for(unsigned j = 0; j < cdb.size(); j++){ //Looping through all lines in the CDB
-					if (!instr->fire && !instr->fired) {
-						if(instr->src_reg[0] > -1 && !instr->src_ready[0]){ //Checking for data availability corresponding to Source Register 1 
-							if((cdb[j].tag == instr->src_tag[0] && cdb[j].reg == (unsigned)instr->src_reg[0])||(all_instrs[instr->src_tag[0]]->cycle_status_update > 0)){
-								instr->src_ready[0] = true; //Mark source register as true, so as to facilitate firing in next cycle
-							}
-						}
-						if(instr->src_reg[1] > -1 && !instr->src_ready[1]){ //Checking for data availability corresponding to Source Register 2
-							if((cdb[j].tag == instr->src_tag[1] && cdb[j].reg == (unsigned)instr->src_reg[1])||(all_instrs[instr->src_tag[1]]->cycle_status_update > 0)){
-								instr->src_ready[1] = true; //Mark source register as true, so as to facilitate firing in next cycle
-							}
-						}
-					}
-				}
-			}
+            if (!waiting && sources_ready(instr))
+                proc->ready[instr->op_code].push(instr->id);
         }
+        proc->dispatched.clear();
     }
 }
 
 /** DISPATCH stage */
-void dispatch(proc_stats_t* p_stats, const cycle_half_t &half) {
+void dispatch(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half) {
     if (half == cycle_half_t::FIRST) {    
-        if (p_stats->max_disp_size < dispatching_queue.size())
-            p_stats->max_disp_size = dispatching_queue.size();
+        if (p_stats->max_disp_size < proc->dispatching_queue.size())
+            p_stats->max_disp_size = proc->dispatching_queue.size();
             
-        p_stats->sum_disp_size += dispatching_queue.size();
+        p_stats->sum_disp_size += proc->dispatching_queue.size();
+        if (rob_full(proc))
+            p_stats->rob_full_cycles++;
 
-        for(unsigned i = 0; i < dispatching_queue.size() && i < (unsigned)scheduling_queue_limit - scheduling_queue.size(); i++){
-            //Prevent excessive reservation into the scheduling queue according to the queue limit
-			auto instr = dispatching_queue[i];            
-            instr->reserved = true;
+        for(unsigned i = 0; i < proc->dispatching_queue.size() && i < dispatch_room(proc); i++){
+            //Prevent excessive reservation into the scheduling queue according to the queue and ROB limits
+			proc_fetched_t* fetched = &proc->dispatching_queue[i];
+            if (!fetched->reserved)
+                post_event(proc, p_stats->cycle_count + 1);
+            fetched->reserved = true;
         }
-    } else { //Prevent excessive addition into the scheduling queue according to the queue limit
-        while (!dispatching_queue.empty() && scheduling_queue.size() < (unsigned)scheduling_queue_limit) {
-            auto instr = dispatching_queue.front();
-			if (!instr->reserved)
+    } else { //Prevent excessive addition into the scheduling queue according to the queue and ROB limits
+        while (!proc->dispatching_queue.empty() && dispatch_room(proc) > 0) {
+            const proc_fetched_t* fetched = &proc->dispatching_queue.front();
+			if (!fetched->reserved)
 				break;
+            if ((fetched->load && proc->lq_size > 0 && proc->lq_used == proc->lq_size)
+                || (fetched->store && proc->sq_size > 0 && proc->sq_used == proc->sq_size))
+                break;  // waiting on a load / store queue entry
+            window_reserve(&proc->window, proc->rob_tail);
+            proc_inst_t* instr = proc_inst(proc, proc->rob_tail);
+            unpack_fetched(fetched, proc->rob_tail, instr);
             //Checking register file for readiness of source operands
-            if (instr->src_reg[0] > -1  && !register_file[instr->src_reg[0]].ready){
-				instr->src_tag[0] = register_file[instr->src_reg[0]].tag;
+            if (instr->src_reg[0] > -1  && !proc->register_file[instr->src_reg[0]].ready){
+				instr->src_tag[0] = proc->register_file[instr->src_reg[0]].tag;
 				instr->src_ready[0] = false;
 			}
 			else {
 				instr->src_ready[0] = true; //Marking source as ready
 			} 
-			if (instr->src_reg[1] > -1  && !register_file[instr->src_reg[1]].ready){
-				instr->src_tag[1] = register_file[instr->src_reg[1]].tag;
+			if (instr->src_reg[1] > -1  && !proc->register_file[instr->src_reg[1]].ready){
+				instr->src_tag[1] = proc->register_file[instr->src_reg[1]].tag;
 				instr->src_ready[1] = false;
 			}
 			else {
 				instr->src_ready[1] = true; //Marking source as ready
 			}
 			//Checking register file for readiness of destination operand
-			if (instr->dest_reg > -1  && !register_file[instr->dest_reg].ready){
-				instr->dest_tag = register_file[instr->dest_reg].tag;
+			if (instr->dest_reg > -1  && !proc->register_file[instr->dest_reg].ready){
+				instr->dest_tag = proc->register_file[instr->dest_reg].tag;
 			}
 			if(instr->dest_reg > -1){ //Update register file with destination operand data
-				register_file[instr->dest_reg].ready = false;
-				register_file[instr->dest_reg].tag = instr->id;
+				proc->register_file[instr->dest_reg].ready = false;
+				proc->register_file[instr->dest_reg].tag = instr->id;
 			}
 			
-            scheduling_queue.push_back(instr);
-			dispatching_queue.pop_front();
+            instr->sched_slot = proc->scheduling_queue.free.back();
+            proc->scheduling_queue.free.pop_back();
+            proc->scheduling_queue.slots[instr->sched_slot] = instr->id;
+            proc->dispatched.push_back(instr->id);
+            proc->rob_tail++;
+            if (proc->lq_size > 0 && instr->load) {
+                proc->load_queue.push_back(instr->id);
+                proc->lq_used++;
+                p_stats->loads++;
+                uint32_t blocker = mem_blocker(proc, instr);
+                if (blocker) {
+                    mem_wait_on(proc, instr, blocker);
+                    p_stats->ordered_loads++;
+                }
+            }
+            if (proc->lq_size > 0 && instr->store) {
+                proc->store_queue.push_back(instr->id);
+                proc->sq_used++;
+            }
+            if (sources_ready(instr))
+                proc->ready[instr->op_code].push(instr->id);
+			proc->dispatching_queue.pop_front();
+			post_event(proc, p_stats->cycle_count + 1);
         }        
     }
 }
 
 /** INSTR-FETCH & DECODE stage */
-void instr_fetch_and_decode(proc_stats_t* p_stats, const cycle_half_t &half) {
+void instr_fetch_and_decode(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half) {
     if (half == cycle_half_t::SECOND) {          
+        // stopped behind a mispredicted branch, or waiting out the redirect
+        if (proc->fetch_branch)
+            return;
+        if (p_stats->cycle_count < proc->fetch_resume) {
+            post_event(proc, proc->fetch_resume);
+            return;
+        }
+
         // read the next instructions 
-        if (!cpu.read_finished){
-            for (uint64_t i = 0; i < cpu.f; i++) { 
-                proc_inst_ptr_t instr = proc_inst_ptr_t(new proc_inst_t());
-              
-                all_instrs.push_back(instr);
-                                
-                if (read_instruction(instr.get())) { 
-                    // reset counters
-                    instr->id = cpu.read_cnt + 1;
-
-                    instr->fire = false;
-                    instr->fired = false;
-                    instr->executed = false;
-
-                    instr->cycle_fetch_decode = p_stats->cycle_count;
-                    instr->cycle_dispatch = p_stats->cycle_count + 1;
-                    instr->cycle_schedule = 0;
-                    instr->cycle_execute = 0;
-                    instr->cycle_status_update = 0;                               
-                    
-                    dispatching_queue.push_back(instr);                                              
-                    cpu.read_cnt++;                     
+        if (!proc->cpu.read_finished){
+            post_event(proc, p_stats->cycle_count + 1);
+            for (uint64_t i = 0; i < proc->cpu.f; i++) { 
+                proc_inst_t read = proc_inst_t();
+                if (proc->read_instruction(proc->read_arg, &read)) { 
+                    proc->dispatching_queue.push_back(pack_fetched(&read, p_stats->cycle_count));
+                    proc_fetched_t* fetched = &proc->dispatching_queue.back();
+                    proc->cpu.read_cnt++;                     
+
+                    // the trace only has the right path, so what follows a
+                    // mispredict is fetched once the branch has resolved
+                    if (fetched->branch && proc->bpred) {
+                        p_stats->branches++;
+                        if (proc->bpred->PredictSpeculative(fetched->instruction_address, &fetched->bpred_hist) != fetched->br_taken) {
+                            fetched->mispredicted = true;
+                            p_stats->mispredictions++;
+                            proc->fetch_branch = proc->cpu.read_cnt;
+                            break;
+                        }
+                    }
                 } else {
-                    all_instrs.pop_back();
-                
-                    cpu.read_finished = true;  
+                    proc->cpu.read_finished = true;  
                     break;
                 }
             }
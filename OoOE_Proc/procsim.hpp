@@ -6,47 +6,28 @@
 #define DEFAULT_K2 3
 #define DEFAULT_R 8
 #define DEFAULT_F 4
+#define DEFAULT_VIOLATION_PENALTY 10
 
 #include <cstdint>
+#include <cstdlib>
 #include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <deque>
-#include <memory>
 #include <utility>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
+#include <queue>
+#include <functional>
 
-typedef enum Op_Type_Enum{
-    OP_ALU,             // ALU(ADD/ SUB/ MUL/ DIV) operaiton
-    OP_LD,              // load operation
-    OP_ST,              // store operation
-    OP_CBR,             // Conditional Branch
-    OP_OTHER,           // Other Ops
-    NUM_OP_TYPE
-} Op_Type;
+#include "trace_rec.h"
+#include "bpred.h"
 
 enum cycle_half_t { FIRST, SECOND };
 
-/* Data structure for Trace Record */ 
-typedef struct Trace_Rec_Struct {
-    uint64_t inst_addr;  // instruction address 
-    uint8_t  op_type;    // optype
-    uint8_t  dest;       // Destination
-    uint8_t  dest_needed; // 
-    uint8_t  src1_reg;       // Source Register 1
-    uint8_t  src2_reg;       // Source Register 2
-    uint8_t  src1_needed; // Source Register 1 needed by this instruction
-    uint8_t  src2_needed; // Source Register 2 needed to this instruction
-    uint8_t  cc_read;    // Conditional Code Read
-    uint8_t  cc_write;   // Conditional Code Write
-    uint64_t mem_addr;   // Load / Store Memory Address
-    uint8_t  mem_write;  // Write 
-    uint8_t  mem_read;   // Read
-    uint8_t  br_dir;     // Branch Direction Taken / Not Taken
-    uint64_t br_target;  // Target Address of Branch
-} Trace_Rec;
+#define NEVER_CYCLE ((uint64_t)-1)
 
 // our extended instruction structure
 typedef struct _proc_inst_t
@@ -55,6 +36,11 @@ typedef struct _proc_inst_t
     int32_t op_code;
     int32_t dest_reg;
     int32_t src_reg[2];
+    bool branch;                // OP_CBR
+    bool br_taken;              // ... and its direction in the trace
+    bool load;                  // OP_LD / OP_ST
+    bool store;
+    uint64_t mem_addr;
     
     uint32_t id;
     uint64_t dest_tag;
@@ -65,6 +51,18 @@ typedef struct _proc_inst_t
     bool fire;
     bool fired;
     bool executed;
+    bool retired;
+
+    uint64_t waiters;           // sources waiting on tag id - 1, see schedule
+    uint64_t next_waiter[2];    // ... the rest of the list this source is on
+    uint32_t cdb_line;          // result bus granted in execute
+    uint32_t sched_slot;        // scheduling queue entry from dispatch to state update
+    bool mispredicted;          // fetch stopped behind this branch
+    uint64_t bpred_hist;        // history it was predicted with
+
+    uint32_t mem_wait;          // load: older store it may not fire before, 0 if none
+    uint32_t next_mem_waiter;   // ... the next load waiting on that store
+    uint32_t mem_waiters;       // store: first load waiting on it
     
     uint64_t cycle_fetch_decode;
     uint64_t cycle_dispatch;
@@ -73,7 +71,48 @@ typedef struct _proc_inst_t
     uint64_t cycle_status_update;
 } proc_inst_t;
 
-typedef std::shared_ptr<proc_inst_t> proc_inst_ptr_t;
+// A fetched instruction waiting to dispatch: what the trace gave and
+// what fetch predicted. The lab's dispatch queue is unbounded, so it
+// holds these rather than proc_inst_ts; dispatch expands the front one
+// into the window, and its id is the next one to dispatch
+struct proc_fetched_t {
+    uint64_t cycle_fetch_decode;
+    union {
+        uint64_t mem_addr;          // load / store
+        uint64_t bpred_hist;        // branch: history it was predicted with
+    };
+    uint32_t instruction_address;
+    int16_t dest_reg;
+    int16_t src_reg[2];
+    int8_t op_code;
+    bool branch : 1;
+    bool br_taken : 1;
+    bool load : 1;
+    bool store : 1;
+    bool mispredicted : 1;
+    bool reserved : 1;              // dispatch takes it next half
+};
+
+// Every instruction from the oldest not yet retired to the newest
+// dispatched, by id. Instructions retire out of order, so a slot is only
+// reused once everything older has retired too; the ring doubles when
+// the span outgrows it. The queues past dispatch hold ids.
+#define PROC_WINDOW_SIZE 1024       // initial entries, a power of 2
+
+struct proc_window_t {
+    std::vector<proc_inst_t> insts;
+    uint64_t mask;                  // entries - 1
+    uint64_t oldest;                // oldest id not retired
+};
+
+// The scheduling queue: a slot per entry, so dispatch and retire never
+// move the others. Age order is the ids', which the ready heaps keep.
+struct proc_sched_t {
+    std::vector<uint32_t> slots;    // id in each slot, 0 if free
+    std::vector<uint32_t> free;     // free slots, the last one freed reused first
+
+    size_t size() const { return slots.size() - free.size(); }
+};
 
 typedef struct _proc_stats_t
 {
@@ -83,8 +122,24 @@ typedef struct _proc_stats_t
     unsigned long max_disp_size;
     double sum_disp_size;
     float avg_disp_size;
+    unsigned long warmup_instruction;   // retire this many before measuring, 0 for none
+    unsigned long warmup_retired;       // retired / cycle count when warmup ended
+    unsigned long warmup_cycles;
+    unsigned long branches;             // with a branch predictor (-bpredpolicy)
+    unsigned long mispredictions;
+    unsigned long mispredict_stall_cycles;  // fetch waiting on a mispredicted branch
+    unsigned long rob_full_cycles;      // dispatch waiting on a full ROB (-rob)
+    unsigned long loads;                // with a load/store queue (-lq, -sq)
+    unsigned long forwarded_loads;      // read an older store in the SQ
+    unsigned long ordered_loads;        // waited on an older store
+    unsigned long ordering_violations;  // fired ahead of an older store to the same address
 } proc_stats_t;
 
+// ids, oldest on top
+typedef std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> proc_id_heap_t;
+
+#define PROC_FU_TYPES 3
+
 // a cdb representation
 struct proc_cdb_t {
     bool free;
@@ -97,7 +152,8 @@ struct proc_settings_t {
     proc_settings_t() { }
     proc_settings_t(uint64_t f, uint64_t begin_dump, uint64_t end_dump) 
         : f(f), begin_dump(begin_dump), end_dump(end_dump),
-        read_cnt(0), read_finished(false), finished(false) { }
+        read_cnt(0), read_finished(false), finished(false),
+        next_event(NEVER_CYCLE) { }
 
     uint64_t f;
 
@@ -107,6 +163,8 @@ struct proc_settings_t {
     uint64_t read_cnt;
     bool read_finished;
     bool finished;
+
+    uint64_t next_event;    // first cycle any stage has work again
 };
 
 struct register_info_t {
@@ -114,17 +172,115 @@ struct register_info_t {
     uint64_t tag;
 };
 
-bool read_instruction(proc_inst_t* p_inst);
+// the machine being simulated
+struct proc_config_t {
+    uint64_t r;             // result buses
+    uint64_t k0;            // FUs of each type
+    uint64_t k1;
+    uint64_t k2;
+    uint64_t f;             // instructions fetched per cycle
+
+    uint64_t begin_dump;    // instructions whose timestamps run_proc prints, 0 for none
+    uint64_t end_dump;
+
+    uint64_t rob_size;      // 0: no ROB, instructions retire out of order at state update
+    uint64_t commit_width;  // ROB commits per cycle, 0 for no limit
+    uint32_t bpred_policy;  // 0: perfect, fetch never stalls, else a BPRED_TYPE
+    BPRED_Config bpred;
+    uint64_t redirect_penalty;  // fetch bubbles after a mispredicted branch updates state
+
+    uint64_t lq_size;       // load and store queue entries, 0 for no memory ordering
+    uint64_t sq_size;
+    uint32_t memdep;        // PROC_MEMDEP_*: when a load may fire ahead of older stores
+    uint64_t violation_penalty; // cycles a load that fired too early waits to fire again
+};
+
+// memory dependence policies
+#define PROC_MEMDEP_CONSERVATIVE 0  // loads wait until every older store has executed
+#define PROC_MEMDEP_PERFECT      1  // ... only for the youngest older store to their address
+#define PROC_MEMDEP_STORE_SETS   2  // ... for the youngest older store in their store set
+#define NUM_PROC_MEMDEP          3
+
+#define PROC_SSIT_SIZE 1024         // store set ids, by load / store address
+
+void proc_config_init(proc_config_t* cfg);  // the lab machine: no ROB, perfect prediction
+bool proc_config_check(const proc_config_t* cfg, const char** why);
+
+// reads the next instruction into p_inst, false at the end of the trace
+typedef bool (*proc_read_fn)(void* arg, proc_inst_t* p_inst);
+
+// one processor: all of its state, so any number can run side by side
+struct proc_t {
+    proc_settings_t cpu;
+
+    proc_read_fn read_instruction;
+    void* read_arg;
+
+    proc_window_t window;
+    std::vector<proc_inst_t> dumped;    // retired instructions in the dump range
+
+    std::deque<proc_fetched_t> dispatching_queue;   // fetched, ids from rob_tail on
+    proc_sched_t scheduling_queue;
+    int scheduling_queue_limit;
+
+    // in-order commit: the ROB is every id dispatched and not committed
+    uint64_t rob_size;
+    uint64_t commit_width;
+    uint64_t rob_head;                  // oldest id not committed
+    uint64_t rob_tail;                  // next id to dispatch
+
+    // front end: fetch stops behind a mispredicted branch until it updates state
+    std::unique_ptr<BPRED> bpred;       // NULL: perfect prediction, kept across setup_proc
+    uint64_t redirect_penalty;
+    uint64_t fetch_branch;              // id fetch is stopped behind, 0 if none
+    uint64_t fetch_resume;              // first cycle fetch runs again
+
+    // memory ordering: loads and stores in flight, oldest first. Out of
+    // order retirement leaves retired ones behind the head until it retires
+    uint64_t lq_size;
+    uint64_t sq_size;
+    uint32_t memdep;
+    uint64_t violation_penalty;
+    std::deque<uint32_t> load_queue;
+    std::deque<uint32_t> store_queue;
+    uint64_t lq_used;
+    uint64_t sq_used;
+    std::vector<uint32_t> store_sets;   // store set id by address, 0 for none
+    uint32_t next_store_set;
+    std::vector<uint32_t> woken_stores; // stores executed this cycle
+    std::deque<std::pair<uint64_t, uint32_t>> replays;  // loads that fired too early, by the cycle they fire again
+
+    std::unordered_map<uint32_t, register_info_t> register_file;
+
+    std::vector<proc_cdb_t> cdb;
+    std::vector<uint64_t> cdb_free;     // a bit per free line
+    std::unordered_map<uint32_t, uint32_t> fu_cnt;
+
+    // wakeup/select: each half only visits the instructions it changes
+    std::vector<uint32_t> dispatched;   // dispatched last cycle, not yet checked for wakeup
+    std::vector<uint64_t> woken_tags;   // tags broadcast or unblocked this cycle
+    proc_id_heap_t ready[PROC_FU_TYPES];    // sources ready, not fired
+    std::vector<uint32_t> firing;       // fire set, fired next half
+    std::vector<uint32_t> fired;        // fired, execute stamps them next cycle
+    proc_id_heap_t waiting_cdb;         // fired, no result bus yet
+    std::vector<uint32_t> completing;   // granted a bus, state update next cycle
+    std::vector<uint32_t> updated;      // state updated, leave the scheduling queue next half
+};
+
+static inline proc_inst_t* proc_inst(proc_t* proc, uint64_t id) {
+    return &proc->window.insts[id & proc->window.mask];
+}
 
-void setup_proc(proc_stats_t *p_stats, uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f, uint64_t begin_dump, uint64_t end_dump);
+void setup_proc(proc_t* proc, const proc_config_t* cfg, proc_read_fn read, void* read_arg, proc_stats_t* p_stats);
+void warm_proc(proc_t* proc, const proc_config_t* cfg, const proc_inst_t* inst);
 void complete_proc(proc_stats_t* p_stats);
-void run_proc(proc_stats_t* p_stats);
+void run_proc(proc_t* proc, proc_stats_t* p_stats);
 
 // our pipeline stages
-void state_update(proc_stats_t* p_stats, const cycle_half_t &half);
-void execute(proc_stats_t* p_stats, const cycle_half_t &half);
-void schedule(proc_stats_t* p_stats, const cycle_half_t &half);
-void dispatch(proc_stats_t* p_stats, const cycle_half_t &half);
-void instr_fetch_and_decode(proc_stats_t* p_stats, const cycle_half_t &half);
+void state_update(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half);
+void execute(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half);
+void schedule(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half);
+void dispatch(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half);
+void instr_fetch_and_decode(proc_t* proc, proc_stats_t* p_stats, const cycle_half_t &half);
 
 #endif /* PROCSIM_H */
@@ -5,10 +5,22 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <inttypes.h>
+#include <string>
 #include "procsim.hpp"
+#include "trace_reader.h"
+#include "trace_prefetch.h"
+#include "trace_simpoint.h"
+#include "trace_sample.h"
 
-FILE* inFile;
+// where a processor's instructions come from
+struct trace_source_t {
+    Trace_Reader* reader;
+    Trace_Prefetcher<proc_inst_t>* prefetch;    // decode thread, or NULL
+    uint64_t max_insts;       // -max: stop reading after this many, 0 for no limit
+    uint64_t num_read;
+};
 
 void print_help_and_exit(void) {
     printf("procsim [OPTIONS]\n");
@@ -17,44 +29,48 @@ void print_help_and_exit(void) {
     printf("  -l k2\t\tNumber of k2 FUs\n");   
     printf("  -f N\t\tNumber of instructions to fetch\n");
     printf("  -r R\t\tNumber of result buses\n");
-    printf("  -i traces/file.trace\n");
+    printf("  -i traces/file.trace\t(gzip'd or raw; stdin if omitted)\n");
+    printf("  -rob N\t\tROB entries, in-order commit (default: none, retire at state update)\n");
+    printf("  -commit N\tInstructions the ROB commits per cycle (default: no limit)\n");
+    printf("  -bpredpolicy N\tBranch predictor, fetch stops behind a mispredict until it\n\t\tupdates state: 0 perfect, 1 always taken, 2 gshare, 3 bimodal,\n\t\t4 tournament, 5 TAGE, 6 perceptron (default: 0)\n");
+    bpred_config_usage();
+    printf("  -redirectpenalty N\tFetch bubbles after a mispredict resolves (default: 0)\n");
+    printf("  -lq N, -sq N\tLoad and store queue entries, loads read older stores to the\n\t\tsame address (default: none, memory order is not modeled)\n");
+    printf("  -memdep P\tWhen a load may fire ahead of older stores: 0 once they have\n\t\tall executed, 1 perfect, 2 store sets; 1 and 2 need -lq and -sq\n\t\t(default: 0)\n");
+    printf("  -violationpenalty N\tCycles a load that fired too early waits to fire again after\n\t\tthe store (default: %d)\n", DEFAULT_VIOLATION_PENALTY);
+    printf("  -p\t\tDecode the trace on a prefetch thread\n");
+    printf("  -skip N\tFast-forward past the first N instructions\n");
+    printf("  -max N\t\tSimulate at most N instructions after that\n");
+    printf("  -simpoints F\tSimulate only the intervals in F (see trace_profile)\n");
+    printf("  -warmup N\tSimulate N instructions ahead of each simpoint unmeasured\n\t\t(default: a tenth of an interval)\n");
+    printf("  -sample U\tSample the trace in windows of U instructions\n");
+    printf("  -samplewarm W\tUnmeasured warmup before each window (default: %d)\n", TRACE_SAMPLE_WARM);
+    printf("  -period N\tWindow spacing in the first pass (default: trace / %d)\n", TRACE_SAMPLE_MIN);
+    printf("  -error E\tStop once IPC is within E%% (default: %g)\n", 100 * TRACE_SAMPLE_TARGET);
+    printf("  -confidence C\t... at C%% confidence (default: %g)\n", 100 * TRACE_SAMPLE_CONFIDENCE);
     printf("  -h\t\tThis helpful output\n");
     exit(0);
 }
 
 //
-// read_instruction
+// decode_instruction
 //
-//  returns true if an instruction was read successfully
+//  maps a trace record onto the fields of p_inst that fetch reads
 //
-bool read_instruction(proc_inst_t* p_inst){
-    if(inFile == NULL){
-        return false;
-    }
-
-    Trace_Rec tr_entry;    
-
-    if (p_inst == NULL){
-        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
-        return false;
-    }
-
-    uint8_t bytes_read = 0;
-    bytes_read = fread(&tr_entry, 1, sizeof(Trace_Rec), inFile);
-    
-    // check for end of trace
-    if( bytes_read < sizeof(Trace_Rec)) {
-        return false;
-    }
-
+void decode_instruction(const Trace_Rec& tr_entry, proc_inst_t* p_inst){
     p_inst->instruction_address = tr_entry.inst_addr;
 
     if(tr_entry.op_type == OP_ALU){
         p_inst->op_code = 0;
     }else if(tr_entry.op_type == OP_LD || tr_entry.op_type == OP_ST){
         p_inst->op_code = 1;
+        p_inst->load = tr_entry.op_type == OP_LD;
+        p_inst->store = tr_entry.op_type == OP_ST;
+        p_inst->mem_addr = tr_entry.mem_addr;
     }else if(tr_entry.op_type == OP_CBR){
         p_inst->op_code = 2;
+        p_inst->branch = true;
+        p_inst->br_taken = tr_entry.br_dir;
     }else if(tr_entry.op_type == OP_OTHER){
         p_inst->op_code = 0;
     }
@@ -76,54 +92,360 @@ bool read_instruction(proc_inst_t* p_inst){
     }else{
         p_inst->src_reg[1] = (-1);
     }    
+}
+
+// producer side of the prefetch thread: hands out fully reset instructions
+bool prefetch_instruction(const Trace_Rec* tr_entry, proc_inst_t* p_inst){
+    *p_inst = proc_inst_t();
+    decode_instruction(*tr_entry, p_inst);
+    return true;
+}
+
+//
+// read_instruction
+//
+//  fetch's proc_read_fn, arg is the trace_source_t
+//  returns true if an instruction was read successfully
+//
+bool read_instruction(void* arg, proc_inst_t* p_inst){
+    trace_source_t* src = (trace_source_t*)arg;
+    if(src->reader == NULL){
+        return false;
+    }
+
+    if (p_inst == NULL){
+        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+        return false;
+    }
+
+    if(src->max_insts && src->num_read >= src->max_insts){
+        return false;
+    }
+
+    if(src->prefetch != NULL){
+        const proc_inst_t* p_next = src->prefetch->Next();
+        if(p_next == NULL) {
+            return false;
+        }
+        *p_inst = *p_next;
+        src->num_read++;
+        return true;
+    }
+
+    const Trace_Rec* p_entry = trace_next(src->reader);
+    
+    // check for end of trace
+    if(p_entry == NULL) {
+        return false;
+    }
 
+    decode_instruction(*p_entry, p_inst);
+    src->num_read++;
     return true;
 }
 
-void print_statistics(proc_stats_t* p_stats);
+//
+// skip_instructions
+//
+//  functional fast-forward before the timed run. Nothing is in flight at
+//  that point, so the register file is all-ready on either side of the
+//  skipped region. The branch predictor is the only state that outlives
+//  a run, and it is trained on every branch skipped (see warm_proc);
+//  with perfect prediction this just repositions.
+//  returns the number of instructions actually skipped
+//
+uint64_t skip_instructions(trace_source_t* src, proc_t* proc, const proc_config_t* cfg, uint64_t count){
+    if(src->reader == NULL){
+        return 0;
+    }
+
+    bool warm = cfg->bpred_policy != BPRED_PERFECT;
+    uint64_t i;
+    if(src->prefetch != NULL){
+        const proc_inst_t* p_next;
+        for(i = 0; i < count && (p_next = src->prefetch->Next()) != NULL; i++){
+            if(warm){
+                warm_proc(proc, cfg, p_next);
+            }
+        }
+        return i;
+    }
+
+    uint64_t start = src->reader->num_read;
+    if(!warm){
+        trace_seek(src->reader, start + count);
+        return src->reader->num_read - start;
+    }
+
+    const Trace_Rec* p_entry;
+    for(i = 0; i < count && (p_entry = trace_next(src->reader)) != NULL; i++){
+        proc_inst_t inst = proc_inst_t();
+        decode_instruction(*p_entry, &inst);
+        warm_proc(proc, cfg, &inst);
+    }
+    return i;
+}
+
+//
+// seek_instruction
+//
+//  moves the trace to record pos, rewinding if it is behind, and warms
+//  the predictor on the way as skip_instructions does
+//  returns true if the trace has a record pos, or ends just before it
+//
+bool seek_instruction(trace_source_t* src, proc_t* proc, const proc_config_t* cfg, uint64_t pos){
+    if(cfg->bpred_policy == BPRED_PERFECT){
+        return trace_seek(src->reader, pos);
+    }
+
+    if(pos < src->reader->num_read && !trace_seek(src->reader, 0)){
+        return false;
+    }
+    uint64_t gap = pos - src->reader->num_read;
+    return skip_instructions(src, proc, cfg, gap) == gap;
+}
+
+//
+// simulate_window
+//
+//  runs the next warm + len instructions on a freshly set up processor
+//  (the predictor carries over) and measures only the last len. The processor's state (queues,
+//  register tags, CDB) fills within a few hundred cycles, so warmup is
+//  done in detail rather than functionally.
+//  returns the number of instructions read, short at end of trace
+//
+uint64_t simulate_window(trace_source_t* src, proc_t* proc, const proc_config_t* cfg,
+                         uint64_t warm, uint64_t len, uint64_t* insts, uint64_t* cycles){
+    proc_stats_t stats;
+    memset(&stats, 0, sizeof(proc_stats_t));
+    stats.warmup_instruction = warm;
+    src->max_insts = warm + len;
+    src->num_read = 0;
+
+    setup_proc(proc, cfg, read_instruction, src, &stats);
+    run_proc(proc, &stats);
+
+    *insts = stats.retired_instruction - stats.warmup_retired;
+    *cycles = stats.cycle_count - stats.warmup_cycles;
+    return src->num_read;
+}
+
+//
+// run_simpoints
+//
+//  simulates each simulation point after up to warmup instructions of
+//  detailed warmup. returns the weighted CPI of the points simulated
+//
+double run_simpoints(trace_source_t* src, proc_t* proc, const proc_config_t* cfg,
+                     const Trace_Simpoint_Set* sp, uint64_t warmup,
+                     uint32_t* num_points, uint64_t* num_detailed){
+    uint64_t len = sp->interval_len;
+    uint64_t pos = 0;
+    double cpi_sum = 0;
+    double weight_sum = 0;
+
+    *num_points = 0;
+    *num_detailed = 0;
+    for(uint32_t i = 0; i < sp->num_points; i++){
+        uint64_t start = sp->points[i].interval * len;
+        uint64_t gap = start - pos;
+        uint64_t warm = (gap < warmup) ? gap : warmup;
+
+        pos += skip_instructions(src, proc, cfg, gap - warm);
+        if(pos < start - warm){
+            break;
+        }
+
+        uint64_t insts, cycles;
+        uint64_t num_read = simulate_window(src, proc, cfg, warm, len, &insts, &cycles);
+        pos += num_read;
+        *num_detailed += num_read;
+        if(num_read <= warm || insts == 0){
+            break;
+        }
+
+        double cpi = (double)cycles / insts;
+        printf("SimPoint %u: interval %" PRIu64 " weight %.4f IPC %f\n",
+               i, sp->points[i].interval, sp->points[i].weight, 1 / cpi);
+        cpi_sum += sp->points[i].weight * cpi;
+        weight_sum += sp->points[i].weight;
+        (*num_points)++;
+    }
+
+    // points past the end of the trace drop out of the average
+    return (weight_sum > 0) ? cpi_sum / weight_sum : 0;
+}
+
+//
+// run_sampled
+//
+//  SMARTS-style sampling (see trace_sample.h): fast-forward to each
+//  window, simulate it, and stop once the CPI estimate is within the
+//  target error. Only the predictor outlives a window, so without one
+//  fast-forward is a seek. A denser pass starts back at the start of
+//  the trace.
+//
+void run_sampled(trace_source_t* src, proc_t* proc, const proc_config_t* cfg,
+                 Trace_Sampler* s, uint64_t* num_detailed){
+    uint64_t window = s->warm + s->unit;
+
+    *num_detailed = 0;
+    for(;;){
+        if(seek_instruction(src, proc, cfg, s->next)){
+            uint64_t insts, cycles;
+            uint64_t num_read = simulate_window(src, proc, cfg, s->warm, s->unit, &insts, &cycles);
+            *num_detailed += num_read;
+            if(num_read == window && insts > 0){
+                trace_sampler_add(s, (double)cycles / insts);
+                if(trace_sampler_done(s)){
+                    break;
+                }
+                continue;
+            }
+        }
+
+        // off the end of the trace
+        if(!trace_sampler_next_pass(s)){
+            break;
+        }
+    }
+}
+
+void print_statistics(proc_stats_t* p_stats, const proc_config_t* cfg);
 
 int main(int argc, char* argv[]) {
     int opt;
-    uint64_t f = DEFAULT_F;
-    uint64_t k0 = DEFAULT_K0;
-    uint64_t k1 = DEFAULT_K1;
-    uint64_t k2 = DEFAULT_K2;
-    uint64_t r = DEFAULT_R;
+    proc_config_t cfg;
+    proc_config_init(&cfg);
 
-    uint64_t begin_dump; 
-    uint64_t end_dump; 
+    uint64_t skip = 0;
+    uint64_t warmup = (uint64_t)-1;
+    const char* simpoint_file = NULL;
+    uint64_t sample_unit = 0;
+    uint64_t sample_warm = TRACE_SAMPLE_WARM;
+    uint64_t sample_period = 0;
+    double sample_error = 100 * TRACE_SAMPLE_TARGET;
+    double sample_confidence = 100 * TRACE_SAMPLE_CONFIDENCE;
 
-    inFile = NULL;
+    trace_source_t src = {NULL, NULL, 0, 0};
+    bool prefetch = false;
+
+    static struct option long_opts[] = {
+        {"skip", required_argument, NULL, 'S'},
+        {"max",  required_argument, NULL, 'M'},
+        {"simpoints", required_argument, NULL, 'P'},
+        {"warmup", required_argument, NULL, 'W'},
+        {"sample", required_argument, NULL, 'U'},
+        {"samplewarm", required_argument, NULL, 'X'},
+        {"period", required_argument, NULL, 'N'},
+        {"error", required_argument, NULL, 'E'},
+        {"confidence", required_argument, NULL, 'C'},
+        {"rob", required_argument, NULL, 'O'},
+        {"commit", required_argument, NULL, 'T'},
+        {"bpredpolicy", required_argument, NULL, 'B'},
+        {"redirectpenalty", required_argument, NULL, 'D'},
+        {"lq", required_argument, NULL, 'L'},
+        {"sq", required_argument, NULL, 'Q'},
+        {"memdep", required_argument, NULL, 'Y'},
+        {"violationpenalty", required_argument, NULL, 'V'},
+        {"bpredbits", required_argument, NULL, 'Z'},     // predictor sizing, see bpred_config_arg
+        {"bpredhist", required_argument, NULL, 'Z'},
+        {"bpredctr", required_argument, NULL, 'Z'},
+        {"tagetables", required_argument, NULL, 'Z'},
+        {"tagebits", required_argument, NULL, 'Z'},
+        {"tagetagbits", required_argument, NULL, 'Z'},
+        {"tagehist", required_argument, NULL, 'Z'},
+        {NULL, 0, NULL, 0}
+    };
 
     /* Read arguments */ 
-    char tr_filename[256];    
-    char cmd_string[256];    
-    while(-1 != (opt = getopt(argc, argv, "r:f:j:k:l:b:e:i:h"))) {
+    char tr_filename[256] = "-";    
+    int long_index = 0;
+    while(-1 != (opt = getopt_long_only(argc, argv, "r:f:j:k:l:b:e:i:ph", long_opts, &long_index))) {
         switch(opt) {
+        case 'O':
+            cfg.rob_size = strtoull(optarg, NULL, 10);
+            break;
+        case 'T':
+            cfg.commit_width = strtoull(optarg, NULL, 10);
+            break;
+        case 'B':
+            cfg.bpred_policy = atoi(optarg);
+            break;
+        case 'D':
+            cfg.redirect_penalty = strtoull(optarg, NULL, 10);
+            break;
+        case 'L':
+            cfg.lq_size = strtoull(optarg, NULL, 10);
+            break;
+        case 'Q':
+            cfg.sq_size = strtoull(optarg, NULL, 10);
+            break;
+        case 'Y':
+            cfg.memdep = atoi(optarg);
+            break;
+        case 'V':
+            cfg.violation_penalty = strtoull(optarg, NULL, 10);
+            break;
+        case 'Z': {
+            std::string name = std::string("-") + long_opts[long_index].name;
+            bpred_config_arg(&cfg.bpred, name.c_str(), optarg);
+            break;
+        }
+        case 'S':
+            skip = strtoull(optarg, NULL, 10);
+            break;
+        case 'M':
+            src.max_insts = strtoull(optarg, NULL, 10);
+            break;
+        case 'P':
+            simpoint_file = optarg;
+            break;
+        case 'W':
+            warmup = strtoull(optarg, NULL, 10);
+            break;
+        case 'U':
+            sample_unit = strtoull(optarg, NULL, 10);
+            break;
+        case 'X':
+            sample_warm = strtoull(optarg, NULL, 10);
+            break;
+        case 'N':
+            sample_period = strtoull(optarg, NULL, 10);
+            break;
+        case 'E':
+            sample_error = atof(optarg);
+            break;
+        case 'C':
+            sample_confidence = atof(optarg);
+            break;
         case 'r':
-            r = atoi(optarg);
+            cfg.r = atoi(optarg);
             break;
         case 'f':
-            f = atoi(optarg);
+            cfg.f = atoi(optarg);
             break;            
         case 'j':
-            k0 = atoi(optarg);
+            cfg.k0 = atoi(optarg);
             break;
         case 'k':
-            k1 = atoi(optarg);
+            cfg.k1 = atoi(optarg);
             break;
         case 'l':
-            k2 = atoi(optarg);
+            cfg.k2 = atoi(optarg);
             break;
         case 'b':
-            begin_dump = atoi(optarg);
+            cfg.begin_dump = atoi(optarg);
             break;
         case 'e':
-            end_dump = atoi(optarg);
+            cfg.end_dump = atoi(optarg);
             break;    
         case 'i':
             strcpy(tr_filename, optarg);
             break;
+        case 'p':
+            prefetch = true;
+            break;
         case 'h':
             /* Fall through */
         default:
@@ -132,46 +454,149 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    sprintf(cmd_string,"gunzip -c %s", tr_filename);    
-    if ((inFile = popen(cmd_string, "r")) == NULL){
-        printf("Command string is %s\n", cmd_string);
-        printf("Unable to open the trace file with gzip option \n");
+    const char* config_why;
+    if (!proc_config_check(&cfg, &config_why)) {
+        printf("%s\n", config_why);
+        exit(1);
+    }
+
+    Trace_Simpoint_Set* simpoints = NULL;
+    if (simpoint_file != NULL) {
+        if (skip > 0 || src.max_insts > 0) {
+            printf("-simpoints cannot be combined with -skip or -max\n");
+            exit(1);
+        }
+        if ((simpoints = trace_simpoints_read(simpoint_file)) == NULL) {
+            printf("Unable to read the simpoint file\n");
+            exit(1);
+        }
+        if (warmup == (uint64_t)-1) {
+            warmup = simpoints->interval_len / 10;
+        }
+    }
+
+    if (sample_unit > 0) {
+        if (simpoint_file != NULL || skip > 0 || src.max_insts > 0 || prefetch) {
+            printf("-sample cannot be combined with -simpoints, -skip, -max or -p\n");
+            exit(1);
+        }
+        if (sample_confidence <= 0 || sample_confidence >= 100) {
+            printf("-confidence must be between 0 and 100\n");
+            exit(1);
+        }
+    }
+
+    if ((src.reader = trace_open(tr_filename)) == NULL){
+        printf("Trace file is %s\n", tr_filename);
+        printf("Unable to open the trace file\n");
     } else {
-        printf("Opened file with command: %s \n", cmd_string);
+        printf("Opened trace file: %s \n", tr_filename);
+        if (prefetch) {
+            src.prefetch = new Trace_Prefetcher<proc_inst_t>(src.reader, prefetch_instruction);
+        }
     } 
 
     printf("Processor Settings\n");
-    printf("R: %" PRIu64 "\n", r);
-    printf("k0: %" PRIu64 "\n", k0);
-    printf("k1: %" PRIu64 "\n", k1);
-    printf("k2: %" PRIu64 "\n", k2);
-    printf("F: %"  PRIu64 "\n", f);
+    printf("R: %" PRIu64 "\n", cfg.r);
+    printf("k0: %" PRIu64 "\n", cfg.k0);
+    printf("k1: %" PRIu64 "\n", cfg.k1);
+    printf("k2: %" PRIu64 "\n", cfg.k2);
+    printf("F: %"  PRIu64 "\n", cfg.f);
+    if (cfg.rob_size > 0) {
+        printf("ROB: %" PRIu64 ", commit width %" PRIu64 "\n", cfg.rob_size, cfg.commit_width);
+    }
+    if (cfg.bpred_policy != BPRED_PERFECT) {
+        printf("Branch predictor: %u, redirect penalty %" PRIu64 "\n", cfg.bpred_policy, cfg.redirect_penalty);
+    }
+    if (cfg.lq_size > 0) {
+        printf("LQ: %" PRIu64 ", SQ: %" PRIu64 ", memory dependences: %u, violation penalty %" PRIu64 "\n",
+               cfg.lq_size, cfg.sq_size, cfg.memdep, cfg.violation_penalty);
+    }
     printf("\n");
 
+    proc_t proc;
+
+    if (simpoints != NULL) {
+        uint32_t num_points;
+        uint64_t num_detailed;
+        double cpi = run_simpoints(&src, &proc, &cfg, simpoints, warmup, &num_points, &num_detailed);
+
+        printf("\nSimPoint stats:\n");
+        printf("Simulation points: %u\n", num_points);
+        printf("Instructions simulated (with warmup): %" PRIu64 "\n", num_detailed);
+        printf("Weighted CPI: %f\n", cpi);
+        printf("Weighted IPC: %f\n", cpi > 0 ? 1 / cpi : 0);
+
+        trace_simpoints_free(simpoints);
+        delete src.prefetch;
+        trace_close(src.reader);
+        return 0;
+    }
+
+    if (sample_unit > 0 && src.reader != NULL) {
+        Trace_Sampler sampler;
+        uint64_t num_detailed;
+        trace_sampler_init(&sampler, sample_unit, sample_warm, sample_period, src.reader->num_recs,
+                           sample_error / 100, sample_confidence / 100);
+        run_sampled(&src, &proc, &cfg, &sampler, &num_detailed);
+
+        printf("Sampling stats:\n");
+        printf("Samples: %" PRIu64 " in %u passes\n", sampler.n, sampler.pass + 1);
+        printf("Instructions simulated (with warmup): %" PRIu64 "\n", num_detailed);
+        printf("Sampled CPI: %f +- %.3f%% at %g%% confidence\n", sampler.mean,
+               100 * trace_sampler_error(&sampler), sample_confidence);
+        printf("Sampled IPC: %f\n", sampler.mean > 0 ? 1 / sampler.mean : 0);
+
+        trace_close(src.reader);
+        return 0;
+    }
+
+    if (skip > 0) {
+        skip = skip_instructions(&src, &proc, &cfg, skip);
+        printf("Skipped instructions: %" PRIu64 "\n\n", skip);
+    }
+
     /* Setup statistics */
     proc_stats_t stats;
     memset(&stats, 0, sizeof(proc_stats_t));    
 
     /* Setup the processor */
-    setup_proc(&stats, r, k0, k1, k2, f, begin_dump, end_dump);
+    setup_proc(&proc, &cfg, read_instruction, &src, &stats);
 
     /* Run the processor */
-    run_proc(&stats);
+    run_proc(&proc, &stats);
 
     /* Finalize stats */
     complete_proc(&stats);
 
-    print_statistics(&stats);
+    print_statistics(&stats, &cfg);
+
+    delete src.prefetch;
+    trace_close(src.reader);
 
     return 0;
 }
 
-void print_statistics(proc_stats_t* p_stats) {
+void print_statistics(proc_stats_t* p_stats, const proc_config_t* cfg) {
     printf("Processor stats:\n");
     printf("Total instructions: %lu\n", p_stats->retired_instruction);    
     printf("Total run time (cycles): %lu\n", p_stats->cycle_count);
     printf("Avg inst retired per cycle: %f\n", p_stats->avg_inst_retired);
     printf("Maximum Dispatch queue size: %lu\n", p_stats->max_disp_size);
     printf("Avg Dispatch queue size: %f\n", p_stats->avg_disp_size);    
+    if (cfg->bpred_policy != BPRED_PERFECT) {
+        printf("Branches: %lu\n", p_stats->branches);
+        printf("Branch mispredictions: %lu\n", p_stats->mispredictions);
+        printf("Fetch cycles stalled on mispredicts: %lu\n", p_stats->mispredict_stall_cycles);
+    }
+    if (cfg->rob_size > 0) {
+        printf("Dispatch cycles stalled on a full ROB: %lu\n", p_stats->rob_full_cycles);
+    }
+    if (cfg->lq_size > 0) {
+        printf("Loads: %lu\n", p_stats->loads);
+        printf("Loads forwarded from the SQ: %lu\n", p_stats->forwarded_loads);
+        printf("Loads held back on an older store: %lu\n", p_stats->ordered_loads);
+        printf("Memory ordering violations: %lu\n", p_stats->ordering_violations);
+    }
 }
 
@@ -0,0 +1,68 @@
+/***********************************************************************
+ * File         : trace_branch.cpp
+ * Description  : mmap reader for branch-only traces
+ **********************************************************************/
+
+#include "trace_branch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+Trace_Branches* trace_branches_open(const char *filename, bool *bad){
+    Trace_Branch_Hdr hdr;
+    struct stat st;
+    const char *why = NULL;
+
+    *bad = false;
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+      return NULL;
+    }
+    if(pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)
+       || memcmp(hdr.magic, TRACE_BRANCH_MAGIC, sizeof(hdr.magic))) {
+      close(fd);
+      return NULL;
+    }
+
+    *bad = true;
+    if(!trace_branch_hdr_check(&hdr, &why)) {
+      fprintf(stderr, "%s: %s\n", filename, why);
+      close(fd);
+      return NULL;
+    }
+    if(fstat(fd, &st) || (uint64_t)st.st_size < hdr.hdr_size + hdr.num_recs * hdr.rec_size) {
+      fprintf(stderr, "%s: trace is truncated\n", filename);
+      close(fd);
+      return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+      perror(filename);
+      return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    Trace_Branches *tb = (Trace_Branches *) calloc (1, sizeof (Trace_Branches));
+    tb->recs      = (const Trace_Branch_Rec *) ((const char *) map + hdr.hdr_size);
+    tb->num_recs  = hdr.num_recs;
+    tb->num_insts = hdr.num_insts;
+    tb->map       = map;
+    tb->map_len   = st.st_size;
+    *bad = false;
+    return tb;
+}
+
+void trace_branches_close(Trace_Branches *tb){
+    if(tb == NULL) {
+      return;
+    }
+    munmap(tb->map, tb->map_len);
+    free(tb);
+}
@@ -0,0 +1,29 @@
+#ifndef _TRACE_BRANCH_H
+#define _TRACE_BRANCH_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "trace_format.h"
+
+/*********************************************************************
+* Branch Trace Reader
+*
+* Maps a branch trace (trace_convert -branch) read-only. The records
+* are used in place; there is nothing to decode.
+**********************************************************************/
+
+typedef struct Trace_Branches_Struct {
+  const Trace_Branch_Rec *recs;
+  uint64_t num_recs;               // branches
+  uint64_t num_insts;              // instructions in the source trace
+  void    *map;
+  size_t   map_len;
+}Trace_Branches;
+
+/* NULL if the file is not a branch trace; *bad is set if it is one
+ * but cannot be used (and a message has been printed) */
+Trace_Branches* trace_branches_open(const char *filename, bool *bad);
+void trace_branches_close(Trace_Branches *tb);
+
+#endif
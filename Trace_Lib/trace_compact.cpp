@@ -0,0 +1,297 @@
+/***********************************************************************
+ * File         : trace_compact.cpp
+ * Description  : Block encoder / bulk decoder for compact traces
+ **********************************************************************/
+
+#include "trace_format.h"
+
+#include <string.h>
+
+static inline uint64_t zigzag(uint64_t delta){
+    return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static inline uint64_t unzigzag(uint64_t z){
+    return (z >> 1) ^ (0 - (z & 1));
+}
+
+/**********************************************************************
+ * Streams: pick the byte width that minimizes packed size plus
+ * exceptions, then write packed values, exception indices and
+ * exception values.
+ **********************************************************************/
+
+#define TRACE_EXC_BYTES (sizeof(uint16_t) + sizeof(uint64_t))
+
+static uint8_t* put_stream(uint8_t *out, const uint64_t *vals, uint32_t count,
+                           Trace_Stream_Desc *desc){
+    static const uint8_t widths[] = {0, 1, 2, 4, 8};
+    uint64_t best_bytes = (uint64_t)-1;
+
+    memset(desc, 0, sizeof(Trace_Stream_Desc));
+    desc->count = count;
+    for(unsigned w = 0; w < sizeof(widths); w++) {
+      uint8_t width = widths[w];
+      uint64_t limit = (width == 8) ? (uint64_t)-1 : (((uint64_t)1 << (8 * width)) - 1);
+      uint32_t num_exc = 0;
+      for(uint32_t ii = 0; ii < count; ii++) {
+        num_exc += (vals[ii] > limit);
+      }
+      uint64_t bytes = (uint64_t)count * width + (uint64_t)num_exc * TRACE_EXC_BYTES;
+      if(num_exc <= 0xFFFF && bytes < best_bytes) {
+        best_bytes = bytes;
+        desc->width = width;
+        desc->num_exc = num_exc;
+      }
+    }
+
+    uint8_t width = desc->width;
+    uint64_t limit = (width == 8) ? (uint64_t)-1 : (((uint64_t)1 << (8 * width)) - 1);
+    uint8_t *exc_idx = out + (uint64_t)count * width;
+    uint8_t *exc_val = exc_idx + desc->num_exc * sizeof(uint16_t);
+    for(uint32_t ii = 0; ii < count; ii++) {
+      uint64_t v = vals[ii];
+      if(v > limit) {
+        uint16_t idx = ii;
+        memcpy(exc_idx, &idx, sizeof(idx));
+        memcpy(exc_val, &v, sizeof(v));
+        exc_idx += sizeof(idx);
+        exc_val += sizeof(v);
+        v = 0;
+      }
+      memcpy(out + (uint64_t)ii * width, &v, width);   // little endian
+    }
+
+    return exc_val;
+}
+
+static uint64_t stream_bytes(const Trace_Stream_Desc *desc){
+    return (uint64_t)desc->count * desc->width + (uint64_t)desc->num_exc * TRACE_EXC_BYTES;
+}
+
+static const uint8_t* get_stream(const uint8_t *in, const Trace_Stream_Desc *desc,
+                                 uint64_t *vals){
+    uint32_t count = desc->count;
+
+    // one flat loop per width so each one vectorizes
+    switch(desc->width) {
+      case 0:
+        memset(vals, 0, count * sizeof(uint64_t));
+        break;
+      case 1:
+        for(uint32_t ii = 0; ii < count; ii++) {
+          vals[ii] = in[ii];
+        }
+        break;
+      case 2:
+        for(uint32_t ii = 0; ii < count; ii++) {
+          uint16_t v;
+          memcpy(&v, in + 2 * ii, sizeof(v));
+          vals[ii] = v;
+        }
+        break;
+      case 4:
+        for(uint32_t ii = 0; ii < count; ii++) {
+          uint32_t v;
+          memcpy(&v, in + 4 * ii, sizeof(v));
+          vals[ii] = v;
+        }
+        break;
+      default:
+        memcpy(vals, in, count * sizeof(uint64_t));
+        break;
+    }
+    in += (uint64_t)count * desc->width;
+
+    const uint8_t *exc_val = in + desc->num_exc * sizeof(uint16_t);
+    for(uint32_t ii = 0; ii < desc->num_exc; ii++) {
+      uint16_t idx;
+      memcpy(&idx, in + ii * sizeof(uint16_t), sizeof(idx));
+      if(idx < count) {
+        memcpy(&vals[idx], exc_val + ii * sizeof(uint64_t), sizeof(uint64_t));
+      }
+    }
+
+    return exc_val + desc->num_exc * sizeof(uint64_t);
+}
+
+/**********************************************************************
+ * Encode one block
+ **********************************************************************/
+
+uint32_t trace_compact_encode(const Trace_Rec *recs, uint32_t n, uint8_t *out){
+    uint64_t vals[TRACE_COMPACT_MAX_BLOCK];
+    Trace_Block_Hdr hdr;
+
+    if(n == 0 || n > TRACE_COMPACT_MAX_BLOCK) {
+      return 0;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.num_recs = n;
+    hdr.base_inst_addr = recs[0].inst_addr;
+
+    uint8_t *col = out + sizeof(Trace_Block_Hdr);
+    uint8_t *has_mem = col + 5 * n;
+    uint8_t *has_tgt = has_mem + (n + 7) / 8;
+    memset(has_mem, 0, 2 * ((n + 7) / 8));
+
+    for(uint32_t ii = 0; ii < n; ii++) {
+      const Trace_Rec *r = &recs[ii];
+      if((r->dest_needed | r->src1_needed | r->src2_needed | r->cc_read | r->cc_write
+          | r->mem_write | r->mem_read | r->br_dir) > 1) {
+        return 0;
+      }
+      col[ii]         = r->op_type;
+      col[n + ii]     = r->dest;
+      col[2 * n + ii] = r->src1_reg;
+      col[3 * n + ii] = r->src2_reg;
+      col[4 * n + ii] = (r->dest_needed ? TRACE_FLAG_DEST_NEEDED : 0)
+                      | (r->src1_needed ? TRACE_FLAG_SRC1_NEEDED : 0)
+                      | (r->src2_needed ? TRACE_FLAG_SRC2_NEEDED : 0)
+                      | (r->cc_read     ? TRACE_FLAG_CC_READ     : 0)
+                      | (r->cc_write    ? TRACE_FLAG_CC_WRITE    : 0)
+                      | (r->mem_write   ? TRACE_FLAG_MEM_WRITE   : 0)
+                      | (r->mem_read    ? TRACE_FLAG_MEM_READ    : 0)
+                      | (r->br_dir      ? TRACE_FLAG_BR_DIR      : 0);
+      if(r->mem_addr) {
+        has_mem[ii >> 3] |= 1 << (ii & 7);
+      }
+      if(r->br_target) {
+        has_tgt[ii >> 3] |= 1 << (ii & 7);
+      }
+    }
+    uint8_t *pos = has_tgt + (n + 7) / 8;
+
+    // inst_addr: delta from the previous record
+    uint64_t prev = hdr.base_inst_addr;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      vals[ii] = zigzag(recs[ii].inst_addr - prev);
+      prev = recs[ii].inst_addr;
+    }
+    pos = put_stream(pos, vals, n, &hdr.addr);
+
+    // mem_addr: delta from the previous non-zero mem_addr
+    uint32_t count = 0;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      if(recs[ii].mem_addr) {
+        if(count == 0) {
+          hdr.base_mem_addr = recs[ii].mem_addr;
+          prev = recs[ii].mem_addr;
+        }
+        vals[count++] = zigzag(recs[ii].mem_addr - prev);
+        prev = recs[ii].mem_addr;
+      }
+    }
+    pos = put_stream(pos, vals, count, &hdr.mem);
+
+    // br_target: offset from the branch itself
+    count = 0;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      if(recs[ii].br_target) {
+        vals[count++] = zigzag(recs[ii].br_target - recs[ii].inst_addr);
+      }
+    }
+    pos = put_stream(pos, vals, count, &hdr.tgt);
+
+    while((pos - out) % 8) {
+      *pos++ = 0;
+    }
+    hdr.block_bytes = pos - out;
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return hdr.block_bytes;
+}
+
+/**********************************************************************
+ * Decode one block. The address columns are unpacked into vals,
+ * zigzag-decoded and prefix-summed, then expanded into the records;
+ * the sparse columns are expanded with a running index instead of a
+ * branch per record.
+ **********************************************************************/
+
+int32_t trace_compact_decode(const uint8_t *blk, uint64_t avail,
+                             Trace_Rec *recs, uint32_t max_recs){
+    uint64_t vals[TRACE_COMPACT_MAX_BLOCK + 1];
+    Trace_Block_Hdr hdr;
+
+    if(avail < sizeof(hdr)) {
+      return -1;
+    }
+    memcpy(&hdr, blk, sizeof(hdr));
+
+    uint32_t n = hdr.num_recs;
+    uint64_t bitmap_bytes = (n + 7) / 8;
+    uint64_t need = sizeof(hdr) + 5 * (uint64_t)n + 2 * bitmap_bytes
+                  + stream_bytes(&hdr.addr) + stream_bytes(&hdr.mem) + stream_bytes(&hdr.tgt);
+    if(n == 0 || n > max_recs || n > TRACE_COMPACT_MAX_BLOCK
+       || hdr.addr.count != n || hdr.mem.count > n || hdr.tgt.count > n
+       || hdr.block_bytes < need || hdr.block_bytes > avail) {
+      return -1;
+    }
+
+    const uint8_t *col = blk + sizeof(hdr);
+    const uint8_t *flags = col + 4 * n;
+    const uint8_t *has_mem = col + 5 * n;
+    const uint8_t *has_tgt = has_mem + bitmap_bytes;
+    const uint8_t *pos = has_tgt + bitmap_bytes;
+
+    for(uint32_t ii = 0; ii < n; ii++) {
+      recs[ii].op_type  = col[ii];
+      recs[ii].dest     = col[n + ii];
+      recs[ii].src1_reg = col[2 * n + ii];
+      recs[ii].src2_reg = col[3 * n + ii];
+    }
+    for(uint32_t ii = 0; ii < n; ii++) {
+      uint8_t f = flags[ii];
+      recs[ii].dest_needed = (f >> 0) & 1;
+      recs[ii].src1_needed = (f >> 1) & 1;
+      recs[ii].src2_needed = (f >> 2) & 1;
+      recs[ii].cc_read     = (f >> 3) & 1;
+      recs[ii].cc_write    = (f >> 4) & 1;
+      recs[ii].mem_write   = (f >> 5) & 1;
+      recs[ii].mem_read    = (f >> 6) & 1;
+      recs[ii].br_dir      = (f >> 7) & 1;
+    }
+
+    // inst_addr
+    pos = get_stream(pos, &hdr.addr, vals);
+    uint64_t addr = hdr.base_inst_addr;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      addr += unzigzag(vals[ii]);
+      recs[ii].inst_addr = addr;
+    }
+
+    // mem_addr
+    pos = get_stream(pos, &hdr.mem, vals);
+    addr = hdr.base_mem_addr;
+    for(uint32_t ii = 0; ii < hdr.mem.count; ii++) {
+      addr += unzigzag(vals[ii]);
+      vals[ii] = addr;
+    }
+    vals[hdr.mem.count] = 0;
+    uint32_t kk = 0;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      uint32_t has = (has_mem[ii >> 3] >> (ii & 7)) & 1;
+      recs[ii].mem_addr = has ? vals[kk] : 0;
+      kk += has;
+    }
+    if(kk != hdr.mem.count) {
+      return -1;
+    }
+
+    // br_target
+    pos = get_stream(pos, &hdr.tgt, vals);
+    vals[hdr.tgt.count] = 0;
+    kk = 0;
+    for(uint32_t ii = 0; ii < n; ii++) {
+      uint32_t has = (has_tgt[ii >> 3] >> (ii & 7)) & 1;
+      recs[ii].br_target = has ? recs[ii].inst_addr + unzigzag(vals[kk]) : 0;
+      kk += has;
+    }
+    if(kk != hdr.tgt.count) {
+      return -1;
+    }
+
+    return n;
+}
@@ -0,0 +1,87 @@
+/***********************************************************************
+ * File         : trace_convert.cpp
+ * Description  : Convert a trace into the native or compact format
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+void die_usage() {
+    printf("Usage : trace_convert [options] <in_trace> <out_trace>\n\n");
+    printf("Converts a trace (gzip'd, raw, native or compact; - for stdin)\n");
+    printf("into a format read directly by sim and procsim.\n");
+    printf("Options\n");
+    printf("   -native      mmap-able native format, no decode at all (Default)\n");
+    printf("   -compact     column-wise delta-encoded blocks, several times smaller\n");
+    printf("   -branch      conditional branches only, for bpred_eval\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    Trace_Format format = TRACE_FMT_NATIVE;
+    const char *in_name = NULL;
+    const char *out_name = NULL;
+
+    for(int ii = 1; ii < argc; ii++) {
+      if(!strcmp(argv[ii], "-native")) {
+        format = TRACE_FMT_NATIVE;
+      } else if(!strcmp(argv[ii], "-compact")) {
+        format = TRACE_FMT_COMPACT;
+      } else if(!strcmp(argv[ii], "-branch")) {
+        format = TRACE_FMT_BRANCH;
+      } else if(argv[ii][0] == '-' && argv[ii][1] != '\0') {
+        die_usage();
+      } else if(in_name == NULL) {
+        in_name = argv[ii];
+      } else if(out_name == NULL) {
+        out_name = argv[ii];
+      } else {
+        die_usage();
+      }
+    }
+    if(out_name == NULL) {
+      die_usage();
+    }
+
+    Trace_Reader *tr = trace_open(in_name);
+    if(tr == NULL) {
+      printf("Error! Unable to open the trace file %s. Exiting...\n", in_name);
+      exit(1);
+    }
+
+    Trace_Writer *tw = trace_writer_open(out_name, format);
+    if(tw == NULL) {
+      printf("Error! Unable to create %s. Exiting...\n", out_name);
+      exit(1);
+    }
+
+    const Trace_Rec *tr_entry;
+    uint64_t num_recs = 0;
+    bool ok = true;
+    while(ok && (tr_entry = trace_next(tr)) != NULL) {
+      ok = trace_write(tw, tr_entry, 1);
+      num_recs++;
+    }
+    bool bad_rec = tw->bad_rec;
+    ok = trace_writer_close(tw) && ok;
+    trace_close(tr);
+
+    if(bad_rec) {
+      printf("Error! Trace has a flag field that is not 0/1, use -native. Exiting...\n");
+      exit(1);
+    }
+    if(!ok) {
+      printf("Error! Write to %s failed. Exiting...\n", out_name);
+      exit(1);
+    }
+    struct stat st;
+    double bytes_per_rec = (num_recs && !stat(out_name, &st)) ? (double)st.st_size / num_recs : 0.0;
+    printf("Wrote %" PRIu64 " records to %s (%.2f bytes/record)\n", num_recs, out_name, bytes_per_rec);
+    return 0;
+}
@@ -0,0 +1,136 @@
+/***********************************************************************
+ * File         : trace_format.cpp
+ * Description  : Header helpers for the on-disk trace formats
+ **********************************************************************/
+
+#include "trace_format.h"
+
+#include <string.h>
+
+static_assert(sizeof(Trace_Native_Hdr) == 64, "native trace header must stay 64 bytes");
+static_assert(sizeof(Trace_Compact_Hdr) == 64, "compact trace header must stay 64 bytes");
+static_assert(sizeof(Trace_Branch_Hdr) == 64, "branch trace header must stay 64 bytes");
+static_assert(sizeof(Trace_Block_Hdr) % 8 == 0, "compact block header must keep 8-byte alignment");
+
+static void trace_field_offsets(uint8_t *off){
+    off[0]  = offsetof(Trace_Rec, inst_addr);
+    off[1]  = offsetof(Trace_Rec, op_type);
+    off[2]  = offsetof(Trace_Rec, dest);
+    off[3]  = offsetof(Trace_Rec, dest_needed);
+    off[4]  = offsetof(Trace_Rec, src1_reg);
+    off[5]  = offsetof(Trace_Rec, src2_reg);
+    off[6]  = offsetof(Trace_Rec, src1_needed);
+    off[7]  = offsetof(Trace_Rec, src2_needed);
+    off[8]  = offsetof(Trace_Rec, cc_read);
+    off[9]  = offsetof(Trace_Rec, cc_write);
+    off[10] = offsetof(Trace_Rec, mem_addr);
+    off[11] = offsetof(Trace_Rec, mem_write);
+    off[12] = offsetof(Trace_Rec, mem_read);
+    off[13] = offsetof(Trace_Rec, br_dir);
+    off[14] = offsetof(Trace_Rec, br_target);
+}
+
+/**********************************************************************
+ * Native header
+ **********************************************************************/
+
+void trace_native_hdr_init(Trace_Native_Hdr *hdr){
+    memset(hdr, 0, sizeof(Trace_Native_Hdr));
+    memcpy(hdr->magic, TRACE_NATIVE_MAGIC, sizeof(hdr->magic));
+    hdr->version    = TRACE_NATIVE_VERSION;
+    hdr->byte_order = TRACE_BYTE_ORDER_MARK;
+    hdr->hdr_size   = sizeof(Trace_Native_Hdr);
+    hdr->rec_size   = sizeof(Trace_Rec);
+    hdr->num_fields = TRACE_NUM_FIELDS;
+    trace_field_offsets(hdr->field_offset);
+}
+
+bool trace_native_hdr_check(const Trace_Native_Hdr *hdr, const char **why){
+    uint8_t off[TRACE_NUM_FIELDS];
+    trace_field_offsets(off);
+
+    const char *err = NULL;
+    if(memcmp(hdr->magic, TRACE_NATIVE_MAGIC, sizeof(hdr->magic))) {
+      err = "not a native trace";
+    } else if(hdr->version != TRACE_NATIVE_VERSION) {
+      err = "unsupported native trace version";
+    } else if(hdr->byte_order != TRACE_BYTE_ORDER_MARK) {
+      err = "native trace was written with a different byte order";
+    } else if(hdr->rec_size != sizeof(Trace_Rec) || hdr->num_fields != TRACE_NUM_FIELDS
+              || memcmp(hdr->field_offset, off, sizeof(off))) {
+      err = "native trace Trace_Rec layout does not match this build";
+    } else if(hdr->hdr_size < sizeof(Trace_Native_Hdr) || hdr->hdr_size % 8) {
+      err = "bad native trace header size";
+    }
+
+    if(why) {
+      *why = err;
+    }
+    return err == NULL;
+}
+
+/**********************************************************************
+ * Compact header
+ **********************************************************************/
+
+void trace_compact_hdr_init(Trace_Compact_Hdr *hdr){
+    memset(hdr, 0, sizeof(Trace_Compact_Hdr));
+    memcpy(hdr->magic, TRACE_COMPACT_MAGIC, sizeof(hdr->magic));
+    hdr->version    = TRACE_COMPACT_VERSION;
+    hdr->byte_order = TRACE_BYTE_ORDER_MARK;
+    hdr->hdr_size   = sizeof(Trace_Compact_Hdr);
+    hdr->block_recs = TRACE_COMPACT_BLOCK_RECS;
+}
+
+bool trace_compact_hdr_check(const Trace_Compact_Hdr *hdr, const char **why){
+    const char *err = NULL;
+    if(memcmp(hdr->magic, TRACE_COMPACT_MAGIC, sizeof(hdr->magic))) {
+      err = "not a compact trace";
+    } else if(hdr->version < 1 || hdr->version > TRACE_COMPACT_VERSION) {
+      err = "unsupported compact trace version";
+    } else if(hdr->byte_order != TRACE_BYTE_ORDER_MARK) {
+      err = "compact trace was written with a different byte order";
+    } else if(hdr->block_recs == 0 || hdr->block_recs > TRACE_COMPACT_MAX_BLOCK) {
+      err = "compact trace block size is not supported";
+    } else if(hdr->hdr_size < sizeof(Trace_Compact_Hdr) || hdr->hdr_size % 8) {
+      err = "bad compact trace header size";
+    }
+
+    if(why) {
+      *why = err;
+    }
+    return err == NULL;
+}
+
+/**********************************************************************
+ * Branch header
+ **********************************************************************/
+
+void trace_branch_hdr_init(Trace_Branch_Hdr *hdr){
+    memset(hdr, 0, sizeof(Trace_Branch_Hdr));
+    memcpy(hdr->magic, TRACE_BRANCH_MAGIC, sizeof(hdr->magic));
+    hdr->version    = TRACE_BRANCH_VERSION;
+    hdr->byte_order = TRACE_BYTE_ORDER_MARK;
+    hdr->hdr_size   = sizeof(Trace_Branch_Hdr);
+    hdr->rec_size   = sizeof(Trace_Branch_Rec);
+}
+
+bool trace_branch_hdr_check(const Trace_Branch_Hdr *hdr, const char **why){
+    const char *err = NULL;
+    if(memcmp(hdr->magic, TRACE_BRANCH_MAGIC, sizeof(hdr->magic))) {
+      err = "not a branch trace";
+    } else if(hdr->version != TRACE_BRANCH_VERSION) {
+      err = "unsupported branch trace version";
+    } else if(hdr->byte_order != TRACE_BYTE_ORDER_MARK) {
+      err = "branch trace was written with a different byte order";
+    } else if(hdr->rec_size != sizeof(Trace_Branch_Rec)) {
+      err = "branch trace record size does not match this build";
+    } else if(hdr->hdr_size < sizeof(Trace_Branch_Hdr) || hdr->hdr_size % 8) {
+      err = "bad branch trace header size";
+    }
+
+    if(why) {
+      *why = err;
+    }
+    return err == NULL;
+}
@@ -0,0 +1,162 @@
+#ifndef _TRACE_FORMAT_H
+#define _TRACE_FORMAT_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "trace_rec.h"
+
+/*********************************************************************
+* On-disk Trace Formats
+*
+* Native: a 64-byte header followed by num_recs raw Trace_Rec entries.
+* The records are exactly what the simulators use in memory, so a
+* native trace is mmap'd and handed out with no decode and no copy.
+* The header records the record size and every field offset; a trace
+* written by a build with a different Trace_Rec layout is rejected.
+*
+* Compact: a 64-byte header followed by self-contained blocks of up to
+* block_recs records. Inside a block every field is stored column-wise:
+* op_type and the three register numbers as byte columns, the eight
+* one-bit fields packed into one flag byte per record, and presence
+* bitmaps for mem_addr / br_target. Addresses are delta-encoded and
+* zigzag'd (inst_addr against the previous inst_addr, mem_addr against
+* the previous non-zero mem_addr, br_target against its own inst_addr)
+* into streams of fixed-width values, where the few values that do not
+* fit the chosen width are patched in from an exception list. Decode is
+* a handful of flat loops per block with no per-record branching.
+*
+* Since version 2 a compact trace ends with a block index (one
+* Trace_Index_Entry per block) so a reader can jump to any record by
+* decoding a single block, and a trace can be cut into slices on block
+* boundaries without touching the blocks in between.
+*
+* Branch: a 64-byte header followed by one 8-byte Trace_Branch_Rec per
+* OP_CBR, nothing else. It is only an input for predictor studies
+* (bpred_eval), which mmap it and never touch the other records; the
+* header keeps the instruction count of the full trace for MPKI.
+**********************************************************************/
+
+#define TRACE_NATIVE_MAGIC    "PTRNATV"   // 7 chars + NUL
+#define TRACE_NATIVE_VERSION  1
+#define TRACE_BYTE_ORDER_MARK 0x01020304u
+#define TRACE_NUM_FIELDS      15
+
+typedef struct Trace_Native_Hdr_Struct {
+  char     magic[8];                     // TRACE_NATIVE_MAGIC
+  uint32_t version;                      // TRACE_NATIVE_VERSION
+  uint32_t byte_order;                   // TRACE_BYTE_ORDER_MARK as written
+  uint32_t hdr_size;                     // offset of the first record
+  uint32_t rec_size;                     // sizeof(Trace_Rec) of the writer
+  uint64_t num_recs;                     // records in the file
+  uint8_t  field_offset[TRACE_NUM_FIELDS]; // offsetof() each Trace_Rec field
+  uint8_t  num_fields;                   // TRACE_NUM_FIELDS
+  uint8_t  reserved[16];
+}Trace_Native_Hdr;
+
+#define TRACE_COMPACT_MAGIC       "PTRCMPT"   // 7 chars + NUL
+#define TRACE_COMPACT_VERSION     2           // 1: no block index
+#define TRACE_COMPACT_BLOCK_RECS  4096        // default records per block
+#define TRACE_COMPACT_MAX_BLOCK   8192        // largest block a reader accepts
+
+typedef struct Trace_Compact_Hdr_Struct {
+  char     magic[8];                     // TRACE_COMPACT_MAGIC
+  uint32_t version;                      // TRACE_COMPACT_VERSION
+  uint32_t byte_order;                   // TRACE_BYTE_ORDER_MARK as written
+  uint32_t hdr_size;                     // offset of the first block
+  uint32_t block_recs;                   // max records in any block
+  uint64_t num_recs;                     // records in the file
+  uint64_t num_blocks;                   // blocks in the file
+  uint64_t index_offset;                 // v2: offset of the block index
+  uint8_t  reserved[16];
+}Trace_Compact_Hdr;
+
+#define TRACE_BRANCH_MAGIC    "PTRBRCH"   // 7 chars + NUL
+#define TRACE_BRANCH_VERSION  1
+
+typedef struct Trace_Branch_Hdr_Struct {
+  char     magic[8];                     // TRACE_BRANCH_MAGIC
+  uint32_t version;                      // TRACE_BRANCH_VERSION
+  uint32_t byte_order;                   // TRACE_BYTE_ORDER_MARK as written
+  uint32_t hdr_size;                     // offset of the first record
+  uint32_t rec_size;                     // sizeof(Trace_Branch_Rec)
+  uint64_t num_recs;                     // branches in the file
+  uint64_t num_insts;                    // instructions in the trace they came from
+  uint8_t  reserved[24];
+}Trace_Branch_Hdr;
+
+typedef struct Trace_Branch_Rec_Struct {
+  uint32_t pc;                           // inst_addr, as BPRED sees it
+  uint8_t  dir;                          // br_dir
+  uint8_t  reserved[3];
+}Trace_Branch_Rec;
+
+/* Block index entry (v2), num_blocks of them at index_offset */
+typedef struct Trace_Index_Entry_Struct {
+  uint64_t offset;                       // file offset of the block
+  uint64_t first_rec;                    // record number of its first record
+}Trace_Index_Entry;
+
+/* Compact flag byte, one per record */
+#define TRACE_FLAG_DEST_NEEDED  0x01
+#define TRACE_FLAG_SRC1_NEEDED  0x02
+#define TRACE_FLAG_SRC2_NEEDED  0x04
+#define TRACE_FLAG_CC_READ      0x08
+#define TRACE_FLAG_CC_WRITE     0x10
+#define TRACE_FLAG_MEM_WRITE    0x20
+#define TRACE_FLAG_MEM_READ     0x40
+#define TRACE_FLAG_BR_DIR       0x80
+
+/* A stream of zigzag'd deltas packed at a fixed byte width */
+typedef struct Trace_Stream_Desc_Struct {
+  uint32_t count;                        // values in the stream
+  uint16_t num_exc;                      // values wider than width bytes
+  uint8_t  width;                        // bytes per packed value: 0,1,2,4,8
+  uint8_t  reserved;
+}Trace_Stream_Desc;
+
+/* Block header. The block body follows it, in this order:
+ *   op_type[n] dest[n] src1_reg[n] src2_reg[n] flags[n]
+ *   has_mem[(n+7)/8] has_tgt[(n+7)/8]
+ *   addr stream, mem stream, tgt stream
+ * where each stream is packed[count*width] exc_idx[num_exc] (uint16)
+ * exc_val[num_exc] (uint64). Blocks are padded to 8 bytes. */
+typedef struct Trace_Block_Hdr_Struct {
+  uint32_t block_bytes;                  // whole block, header and padding included
+  uint32_t num_recs;
+  uint64_t base_inst_addr;               // delta base for the first record
+  uint64_t base_mem_addr;                // delta base for the first mem_addr
+  Trace_Stream_Desc addr;                // inst_addr deltas, count == num_recs
+  Trace_Stream_Desc mem;                 // non-zero mem_addr deltas
+  Trace_Stream_Desc tgt;                 // non-zero br_target - inst_addr
+}Trace_Block_Hdr;
+
+/* Upper bound on the encoded size of a block of n records */
+#define TRACE_COMPACT_MAX_BYTES(n) \
+  (sizeof(Trace_Block_Hdr) + 5 * (n) + 2 * (((n) + 7) / 8) + 3 * 8 * (n) + 8)
+
+/* Fill in the layout part of a header for this build's Trace_Rec */
+void trace_native_hdr_init(Trace_Native_Hdr *hdr);
+
+/* true if hdr describes a trace this build can map directly */
+bool trace_native_hdr_check(const Trace_Native_Hdr *hdr, const char **why);
+
+void trace_compact_hdr_init(Trace_Compact_Hdr *hdr);
+bool trace_compact_hdr_check(const Trace_Compact_Hdr *hdr, const char **why);
+
+void trace_branch_hdr_init(Trace_Branch_Hdr *hdr);
+bool trace_branch_hdr_check(const Trace_Branch_Hdr *hdr, const char **why);
+
+/* Encode n (1..TRACE_COMPACT_MAX_BLOCK, 8192) records into out, which
+ * must hold TRACE_COMPACT_MAX_BYTES(n). Returns the block size, or 0 if
+ * n is out of range or a record has a one-bit field that is neither 0
+ * nor 1. */
+uint32_t trace_compact_encode(const Trace_Rec *recs, uint32_t n, uint8_t *out);
+
+/* Decode the block at blk (at most avail bytes) into recs, which must
+ * hold max_recs. Returns the number of records, or -1 if the block is
+ * malformed. */
+int32_t trace_compact_decode(const uint8_t *blk, uint64_t avail,
+                             Trace_Rec *recs, uint32_t max_recs);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef _TRACE_PREFETCH_H
+#define _TRACE_PREFETCH_H
+
+#include <inttypes.h>
+#include <atomic>
+#include <thread>
+
+#include "trace_reader.h"
+
+/*********************************************************************
+* Trace Prefetcher
+*
+* Runs trace decode on its own thread, ahead of the simulator. The
+* producer pulls records from a Trace_Reader, converts each one with
+* a caller-supplied function (a plain copy for sim, the Trace_Rec to
+* proc_inst_t mapping for procsim) and pushes it into a single-producer
+* single-consumer ring. Both sides only publish their index once per
+* batch, so the consumer's Next() is normally a load and an increment.
+*
+* Convert returns false to drop a record from the stream.
+**********************************************************************/
+
+#define TRACE_PREFETCH_RING   (1 << 14)   // entries, power of two
+#define TRACE_PREFETCH_BATCH  256         // entries per index publish
+
+template <typename T>
+class Trace_Prefetcher {
+public:
+  typedef bool (*Convert_Fn)(const Trace_Rec *tr_entry, T *out);
+
+  Trace_Prefetcher(Trace_Reader *tr_reader, Convert_Fn convert,
+                   uint32_t ring_size = TRACE_PREFETCH_RING)
+    : reader(tr_reader), convert(convert), ring(new T[ring_size]),
+      mask(ring_size - 1), head(0), tail(0), done(false), stop(false),
+      cons_pos(0), cons_limit(0) {
+    producer = std::thread(&Trace_Prefetcher::Produce, this);
+  }
+
+  ~Trace_Prefetcher() {
+    stop.store(true, std::memory_order_relaxed);
+    producer.join();
+    delete[] ring;
+  }
+
+  /* Next converted entry, or NULL at end of trace. The pointer stays
+   * valid until the following call. */
+  const T* Next() {
+    if((cons_pos & (TRACE_PREFETCH_BATCH - 1)) == 0) {
+      tail.store(cons_pos, std::memory_order_release);
+    }
+    if(cons_pos == cons_limit && !Wait()) {
+      return NULL;
+    }
+    return &ring[cons_pos++ & mask];
+  }
+
+private:
+  Trace_Reader *reader;
+  Convert_Fn convert;
+  T *ring;
+  uint64_t mask;
+
+  // head, tail and the consumer's private state sit on separate cache
+  // lines so the two threads do not false-share
+  char pad0[64];
+  std::atomic<uint64_t> head;               // written by producer
+  char pad1[64];
+  std::atomic<uint64_t> tail;               // written by consumer
+  std::atomic<bool> done;
+  std::atomic<bool> stop;
+  char pad2[64];
+
+  uint64_t cons_pos;                        // consumer private
+  uint64_t cons_limit;
+  std::thread producer;
+
+  // wait for the producer to get ahead of cons_pos, false at end of trace
+  bool Wait() {
+    tail.store(cons_pos, std::memory_order_release);
+    for(;;) {
+      cons_limit = head.load(std::memory_order_acquire);
+      if(cons_limit != cons_pos) {
+        return true;
+      }
+      if(done.load(std::memory_order_acquire)) {
+        cons_limit = head.load(std::memory_order_acquire);
+        return cons_limit != cons_pos;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void Produce() {
+    uint64_t prod_pos = 0;
+    uint64_t free_limit = mask + 1;           // prod_pos may run up to here
+
+    while(!stop.load(std::memory_order_relaxed)) {
+      if(prod_pos == free_limit) {
+        free_limit = tail.load(std::memory_order_acquire) + mask + 1;
+        if(prod_pos == free_limit) {
+          std::this_thread::yield();
+          continue;
+        }
+      }
+
+      uint64_t batch_end = prod_pos + TRACE_PREFETCH_BATCH;
+      if(batch_end > free_limit) {
+        batch_end = free_limit;
+      }
+
+      bool eof = false;
+      while(prod_pos < batch_end) {
+        const Trace_Rec *tr_entry = trace_next(reader);
+        if(tr_entry == NULL) {
+          eof = true;
+          break;
+        }
+        if(convert(tr_entry, &ring[prod_pos & mask])) {
+          prod_pos++;
+        }
+      }
+      head.store(prod_pos, std::memory_order_release);
+
+      if(eof) {
+        done.store(true, std::memory_order_release);
+        return;
+      }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,429 @@
+/***********************************************************************
+ * File         : trace_profile.cpp
+ * Description  : Basic-block vector profile of a trace, clustered into
+ *                weighted simulation points
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "trace_reader.h"
+#include "trace_simpoint.h"
+
+#define PROFILE_INTERVAL  1000000   // default instructions per interval
+#define PROFILE_MAX_K     10        // default largest number of clusters
+#define PROFILE_DIM       15        // default projected dimensions
+#define PROFILE_INITS     5         // k-means restarts per k
+#define PROFILE_ITERS     100       // k-means iterations per restart
+#define PROFILE_BIC_FRAC  0.9       // pick the smallest k within this much of the best BIC
+
+void die_usage() {
+    printf("Usage : trace_profile [options] <in_trace> <out_simpoints>\n\n");
+    printf("Profiles basic-block vectors over fixed intervals of a trace, clusters\n");
+    printf("them and writes one weighted simulation point per cluster.\n");
+    printf("Options\n");
+    printf("   -i    <num>    Instructions per interval (Default: %d)\n", PROFILE_INTERVAL);
+    printf("   -k    <num>    Largest number of clusters to try (Default: %d)\n", PROFILE_MAX_K);
+    printf("   -dim  <num>    Random projection dimensions (Default: %d)\n", PROFILE_DIM);
+    printf("   -seed <num>    Projection / clustering seed (Default: 1)\n");
+    printf("   -bbv  <file>   Also write the raw vectors in SimPoint .bb format\n");
+    exit(1);
+}
+
+static uint64_t mix64(uint64_t x){
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// uniform in [0, 1)
+static double rand_unit(uint64_t *state){
+    *state = mix64(*state);
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double dist2(const double *a, const double *b, uint32_t dim){
+    double sum = 0;
+    for(uint32_t d = 0; d < dim; d++) {
+      sum += (a[d] - b[d]) * (a[d] - b[d]);
+    }
+    return sum;
+}
+
+/**********************************************************************
+ * Profile: a basic block starts at the first record and after every
+ * OP_CBR, and is named by its start address. Each interval's vector
+ * holds the instructions executed in every block, normalized by the
+ * interval length and randomly projected down to dim dimensions, as
+ * SimPoint does.
+ **********************************************************************/
+
+typedef struct Profile_Struct {
+  uint32_t dim;
+  uint64_t seed;
+  FILE    *bbv_file;
+
+  std::unordered_map<uint64_t, uint32_t> bb_ids;
+  std::vector<double>   proj;             // dim weights per block
+  std::vector<uint64_t> counts;           // per block, this interval
+  std::vector<uint32_t> touched;          // blocks with counts != 0
+  std::vector<double>   vecs;             // dim per interval
+  uint64_t num_intervals;
+}Profile;
+
+static uint32_t profile_bb_id(Profile *prof, uint64_t addr){
+    auto it = prof->bb_ids.find(addr);
+    if(it != prof->bb_ids.end()) {
+      return it->second;
+    }
+
+    uint32_t id = prof->bb_ids.size();
+    prof->bb_ids[addr] = id;
+    prof->counts.push_back(0);
+    uint64_t state = prof->seed ^ mix64(addr);
+    for(uint32_t d = 0; d < prof->dim; d++) {
+      prof->proj.push_back(2 * rand_unit(&state) - 1);
+    }
+    return id;
+}
+
+static void profile_charge(Profile *prof, uint32_t bb, uint64_t num_inst){
+    if(prof->counts[bb] == 0) {
+      prof->touched.push_back(bb);
+    }
+    prof->counts[bb] += num_inst;
+}
+
+static void profile_end_interval(Profile *prof, uint64_t num_inst){
+    size_t base = prof->vecs.size();
+    prof->vecs.resize(base + prof->dim, 0.0);
+    double *vec = &prof->vecs[base];
+
+    if(prof->bbv_file) {
+      fputc('T', prof->bbv_file);
+    }
+    for(uint32_t bb : prof->touched) {
+      double frac = (double)prof->counts[bb] / num_inst;
+      for(uint32_t d = 0; d < prof->dim; d++) {
+        vec[d] += frac * prof->proj[(size_t)bb * prof->dim + d];
+      }
+      if(prof->bbv_file) {
+        fprintf(prof->bbv_file, ":%u:%" PRIu64 " ", bb + 1, prof->counts[bb]);
+      }
+      prof->counts[bb] = 0;
+    }
+    if(prof->bbv_file) {
+      fputc('\n', prof->bbv_file);
+    }
+    prof->touched.clear();
+    prof->num_intervals++;
+}
+
+/**********************************************************************
+ * Clustering: k-means (k-means++ seeding, a few restarts) for each k,
+ * scored with the Bayesian Information Criterion under a spherical
+ * Gaussian model.
+ **********************************************************************/
+
+typedef struct Clustering_Struct {
+  uint32_t k;
+  std::vector<double>   centers;
+  std::vector<uint32_t> assign;
+  double sse;
+  double bic;
+}Clustering;
+
+static void kmeans(const Profile *prof, uint32_t k, uint64_t *state, Clustering *c){
+    uint32_t dim = prof->dim;
+    uint64_t n = prof->num_intervals;
+    const double *pts = &prof->vecs[0];
+    std::vector<double> near(n);
+
+    c->k = k;
+    c->centers.assign((size_t)k * dim, 0.0);
+    c->assign.assign(n, 0);
+
+    // k-means++: each next center is drawn in proportion to its
+    // squared distance from the nearest one chosen so far
+    uint64_t first = (uint64_t)(rand_unit(state) * n);
+    memcpy(&c->centers[0], pts + first * dim, dim * sizeof(double));
+    for(uint64_t ii = 0; ii < n; ii++) {
+      near[ii] = dist2(pts + ii * dim, &c->centers[0], dim);
+    }
+    for(uint32_t jj = 1; jj < k; jj++) {
+      double total = 0;
+      for(uint64_t ii = 0; ii < n; ii++) {
+        total += near[ii];
+      }
+      double target = rand_unit(state) * total;
+      uint64_t pick = n - 1;
+      for(uint64_t ii = 0; ii < n; ii++) {
+        target -= near[ii];
+        if(target < 0) {
+          pick = ii;
+          break;
+        }
+      }
+      double *center = &c->centers[(size_t)jj * dim];
+      memcpy(center, pts + pick * dim, dim * sizeof(double));
+      for(uint64_t ii = 0; ii < n; ii++) {
+        double d2 = dist2(pts + ii * dim, center, dim);
+        if(d2 < near[ii]) {
+          near[ii] = d2;
+        }
+      }
+    }
+
+    std::vector<double>   sums((size_t)k * dim);
+    std::vector<uint64_t> sizes(k);
+    for(uint32_t iter = 0; iter < PROFILE_ITERS; iter++) {
+      bool changed = false;
+      c->sse = 0;
+      for(uint64_t ii = 0; ii < n; ii++) {
+        uint32_t best = 0;
+        double best_d2 = dist2(pts + ii * dim, &c->centers[0], dim);
+        for(uint32_t jj = 1; jj < k; jj++) {
+          double d2 = dist2(pts + ii * dim, &c->centers[(size_t)jj * dim], dim);
+          if(d2 < best_d2) {
+            best_d2 = d2;
+            best = jj;
+          }
+        }
+        changed |= (iter == 0) || (c->assign[ii] != best);
+        c->assign[ii] = best;
+        c->sse += best_d2;
+      }
+      if(!changed) {
+        break;
+      }
+
+      std::fill(sums.begin(), sums.end(), 0.0);
+      std::fill(sizes.begin(), sizes.end(), 0);
+      for(uint64_t ii = 0; ii < n; ii++) {
+        uint32_t jj = c->assign[ii];
+        sizes[jj]++;
+        for(uint32_t d = 0; d < dim; d++) {
+          sums[(size_t)jj * dim + d] += pts[ii * dim + d];
+        }
+      }
+      for(uint32_t jj = 0; jj < k; jj++) {
+        if(sizes[jj] == 0) {
+          continue;                     // keep an empty cluster's center
+        }
+        for(uint32_t d = 0; d < dim; d++) {
+          c->centers[(size_t)jj * dim + d] = sums[(size_t)jj * dim + d] / sizes[jj];
+        }
+      }
+    }
+}
+
+static double bic_score(const Profile *prof, const Clustering *c){
+    double R = prof->num_intervals;
+    double M = prof->dim;
+    double K = c->k;
+    if(R <= K) {
+      return -HUGE_VAL;
+    }
+
+    std::vector<uint64_t> sizes(c->k);
+    for(uint32_t jj : c->assign) {
+      sizes[jj]++;
+    }
+
+    double var = c->sse / (M * (R - K));
+    if(var < 1e-12) {
+      var = 1e-12;
+    }
+    double loglike = -R * M / 2 * log(2 * M_PI * var) - M * (R - K) / 2;
+    for(uint64_t size : sizes) {
+      if(size) {
+        loglike += size * log(size / R);
+      }
+    }
+    double params = K * (M + 1);
+    return loglike - params / 2 * log(R);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t interval_len = PROFILE_INTERVAL;
+    uint32_t max_k = PROFILE_MAX_K;
+    const char *in_name = NULL;
+    const char *out_name = NULL;
+    const char *bbv_name = NULL;
+
+    Profile prof;
+    prof.dim = PROFILE_DIM;
+    prof.seed = 1;
+    prof.bbv_file = NULL;
+    prof.num_intervals = 0;
+
+    for(int ii = 1; ii < argc; ii++) {
+      if(!strcmp(argv[ii], "-i") && ii < argc - 1) {
+        interval_len = strtoull(argv[++ii], NULL, 10);
+      } else if(!strcmp(argv[ii], "-k") && ii < argc - 1) {
+        max_k = atoi(argv[++ii]);
+      } else if(!strcmp(argv[ii], "-dim") && ii < argc - 1) {
+        prof.dim = atoi(argv[++ii]);
+      } else if(!strcmp(argv[ii], "-seed") && ii < argc - 1) {
+        prof.seed = strtoull(argv[++ii], NULL, 10);
+      } else if(!strcmp(argv[ii], "-bbv") && ii < argc - 1) {
+        bbv_name = argv[++ii];
+      } else if(argv[ii][0] == '-' && argv[ii][1]) {
+        die_usage();
+      } else if(in_name == NULL) {
+        in_name = argv[ii];
+      } else if(out_name == NULL) {
+        out_name = argv[ii];
+      } else {
+        die_usage();
+      }
+    }
+    if(out_name == NULL || interval_len == 0 || max_k == 0 || prof.dim == 0) {
+      die_usage();
+    }
+
+    Trace_Reader *tr = trace_open(in_name);
+    if(tr == NULL) {
+      printf("Error! Unable to open the trace file %s. Exiting...\n", in_name);
+      exit(1);
+    }
+    if(bbv_name && (prof.bbv_file = fopen(bbv_name, "w")) == NULL) {
+      printf("Error! Unable to create %s. Exiting...\n", bbv_name);
+      exit(1);
+    }
+
+    // ------- Profile ---------------------------------------------------
+    const Trace_Rec *tr_entry;
+    uint64_t in_interval = 0;
+    uint64_t bb_len = 0;
+    uint32_t bb = 0;
+    bool bb_start = true;
+    while((tr_entry = trace_next(tr)) != NULL) {
+      if(bb_start) {
+        bb = profile_bb_id(&prof, tr_entry->inst_addr);
+        bb_start = false;
+      }
+      bb_len++;
+      in_interval++;
+      if(tr_entry->op_type == OP_CBR) {
+        profile_charge(&prof, bb, bb_len);
+        bb_len = 0;
+        bb_start = true;
+      }
+      if(in_interval == interval_len) {
+        // a block that straddles the boundary is split between intervals
+        if(bb_len) {
+          profile_charge(&prof, bb, bb_len);
+          bb_len = 0;
+        }
+        profile_end_interval(&prof, in_interval);
+        in_interval = 0;
+      }
+    }
+    if(bb_len) {
+      profile_charge(&prof, bb, bb_len);
+    }
+    // a short tail would skew its cluster, keep it only if it is at
+    // least half an interval
+    if(in_interval && 2 * in_interval >= interval_len) {
+      profile_end_interval(&prof, in_interval);
+      in_interval = 0;
+    }
+    uint64_t num_recs = tr->num_read;
+    trace_close(tr);
+    if(prof.bbv_file) {
+      fclose(prof.bbv_file);
+    }
+
+    printf("%s: %" PRIu64 " instructions, %" PRIu64 " intervals of %" PRIu64 ", %u basic blocks\n",
+           in_name, num_recs, prof.num_intervals, interval_len, (uint32_t)prof.bb_ids.size());
+    if(in_interval) {
+      printf("Dropped the last %" PRIu64 " instructions (under half an interval)\n", in_interval);
+    }
+    if(prof.num_intervals == 0) {
+      printf("Error! Trace is shorter than half an interval. Exiting...\n");
+      exit(1);
+    }
+
+    // ------- Cluster ---------------------------------------------------
+    if(max_k > prof.num_intervals) {
+      max_k = prof.num_intervals;
+    }
+    std::vector<Clustering> runs(max_k + 1);
+    uint64_t state = prof.seed;
+    double bic_min = HUGE_VAL, bic_max = -HUGE_VAL;
+    for(uint32_t k = 1; k <= max_k; k++) {
+      Clustering trial;
+      for(uint32_t init = 0; init < PROFILE_INITS; init++) {
+        kmeans(&prof, k, &state, &trial);
+        if(init == 0 || trial.sse < runs[k].sse) {
+          runs[k] = trial;
+        }
+      }
+      runs[k].bic = bic_score(&prof, &runs[k]);
+      if(runs[k].bic > -HUGE_VAL) {
+        bic_min = std::min(bic_min, runs[k].bic);
+        bic_max = std::max(bic_max, runs[k].bic);
+      }
+      printf("k %2u  BIC %12.2f\n", k, runs[k].bic);
+    }
+
+    uint32_t pick = 1;
+    for(uint32_t k = 1; k <= max_k; k++) {
+      if(runs[k].bic > -HUGE_VAL && runs[k].bic >= bic_min + PROFILE_BIC_FRAC * (bic_max - bic_min)) {
+        pick = k;
+        break;
+      }
+    }
+    const Clustering &c = runs[pick];
+
+    // ------- Pick the interval nearest each center ---------------------
+    std::vector<uint64_t> rep(pick, (uint64_t)-1);
+    std::vector<double>   rep_d2(pick, HUGE_VAL);
+    std::vector<uint64_t> sizes(pick, 0);
+    for(uint64_t ii = 0; ii < prof.num_intervals; ii++) {
+      uint32_t jj = c.assign[ii];
+      double d2 = dist2(&prof.vecs[ii * prof.dim], &c.centers[(size_t)jj * prof.dim], prof.dim);
+      sizes[jj]++;
+      if(d2 < rep_d2[jj]) {
+        rep_d2[jj] = d2;
+        rep[jj] = ii;
+      }
+    }
+
+    Trace_Simpoint_Set sp;
+    std::vector<Trace_Simpoint> points;
+    for(uint32_t jj = 0; jj < pick; jj++) {
+      if(sizes[jj]) {
+        Trace_Simpoint pt = { rep[jj], (double)sizes[jj] / prof.num_intervals };
+        points.push_back(pt);
+      }
+    }
+    std::sort(points.begin(), points.end(),
+              [](const Trace_Simpoint &a, const Trace_Simpoint &b) { return a.interval < b.interval; });
+    sp.interval_len = interval_len;
+    sp.num_points = points.size();
+    sp.points = &points[0];
+
+    char comment[1200];
+    snprintf(comment, sizeof(comment), "trace_profile %s: %" PRIu64 " intervals, k %u",
+             in_name, prof.num_intervals, pick);
+    if(!trace_simpoints_write(out_name, &sp, comment)) {
+      printf("Error! Write to %s failed. Exiting...\n", out_name);
+      exit(1);
+    }
+
+    printf("Chose k %u: %u simulation points, %.1f%% of the trace\n", pick, sp.num_points,
+           100.0 * sp.num_points / prof.num_intervals);
+    for(uint32_t ii = 0; ii < sp.num_points; ii++) {
+      printf("  interval %6" PRIu64 "  weight %.4f\n", sp.points[ii].interval, sp.points[ii].weight);
+    }
+    return 0;
+}
@@ -0,0 +1,340 @@
+/***********************************************************************
+ * File         : trace_reader.cpp
+ * Description  : In-process block reader for gzip / raw / native / compact traces
+ **********************************************************************/
+
+#include "trace_reader.h"
+#include "trace_format.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+/**********************************************************************
+ * Map a native or compact trace. Returns false (and leaves tr
+ * untouched) if fd is neither; one that cannot be used is an error.
+ **********************************************************************/
+
+static bool trace_map(Trace_Reader *tr, int fd, const char *filename, bool *bad){
+    union {
+      Trace_Native_Hdr  native;
+      Trace_Compact_Hdr compact;
+    } hdr;
+    struct stat st;
+    const char *why = NULL;
+    uint64_t need;
+
+    *bad = false;
+    if(pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+      return false;
+    }
+
+    bool native = !memcmp(hdr.native.magic, TRACE_NATIVE_MAGIC, sizeof(hdr.native.magic));
+    bool compact = !memcmp(hdr.compact.magic, TRACE_COMPACT_MAGIC, sizeof(hdr.compact.magic));
+    if(!memcmp(hdr.native.magic, TRACE_BRANCH_MAGIC, sizeof(hdr.native.magic))) {
+      fprintf(stderr, "%s: branch traces can only be read by bpred_eval\n", filename);
+      *bad = true;
+      return false;
+    }
+    if(!native && !compact) {
+      return false;
+    }
+
+    *bad = true;
+    if(native ? !trace_native_hdr_check(&hdr.native, &why)
+              : !trace_compact_hdr_check(&hdr.compact, &why)) {
+      fprintf(stderr, "%s: %s\n", filename, why);
+      return false;
+    }
+    need = native ? hdr.native.hdr_size + hdr.native.num_recs * hdr.native.rec_size
+                  : hdr.compact.hdr_size;
+    if(fstat(fd, &st) || (uint64_t)st.st_size < need) {
+      fprintf(stderr, "%s: trace is truncated\n", filename);
+      return false;
+    }
+
+    size_t len = st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED) {
+      perror(filename);
+      return false;
+    }
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    tr->map     = map;
+    tr->map_len = len;
+    if(native) {
+      tr->buf      = (const Trace_Rec *) ((const char *) map + hdr.native.hdr_size);
+      tr->buf_cnt  = hdr.native.num_recs;
+      tr->num_recs = hdr.native.num_recs;
+      tr->eof      = true;
+    } else {
+      tr->dec_buf  = (Trace_Rec *) calloc (TRACE_READER_BUF_RECS, sizeof (Trace_Rec));
+      tr->buf      = tr->dec_buf;
+      tr->blk_first  = (const uint8_t *) map + hdr.compact.hdr_size;
+      tr->blk_next   = tr->blk_first;
+      tr->blk_end    = (const uint8_t *) map + len;
+      tr->num_recs   = hdr.compact.num_recs;
+      tr->num_blocks = hdr.compact.num_blocks;
+      if(hdr.compact.version >= 2) {
+        if(hdr.compact.index_offset < hdr.compact.hdr_size || hdr.compact.index_offset
+           + hdr.compact.num_blocks * sizeof(Trace_Index_Entry) > len) {
+          fprintf(stderr, "%s: bad compact trace index\n", filename);
+          munmap(map, len);
+          free(tr->dec_buf);
+          tr->map = NULL;
+          tr->dec_buf = NULL;
+          return false;
+        }
+        tr->blk_end = (const uint8_t *) map + hdr.compact.index_offset;
+        tr->index   = (const Trace_Index_Entry *) ((const uint8_t *) map + hdr.compact.index_offset);
+      }
+    }
+    *bad = false;
+    return true;
+}
+
+/**********************************************************************
+ * Open a trace. Native and compact traces are mapped; otherwise gzip
+ * input is detected by zlib and anything else is read through
+ * unchanged, so both .ptr.gz and plain dumps work.
+ **********************************************************************/
+
+Trace_Reader* trace_open(const char *filename){
+    Trace_Reader *tr = (Trace_Reader *) calloc (1, sizeof (Trace_Reader));
+    gzFile gz;
+
+    if(filename == NULL || !strcmp(filename, "-")) {
+      int fd = dup(fileno(stdin));
+      gz = (fd < 0) ? NULL : gzdopen(fd, "rb");
+    } else {
+      int fd = open(filename, O_RDONLY);
+      if(fd < 0) {
+        free(tr);
+        return NULL;
+      }
+
+      bool bad;
+      bool mapped = trace_map(tr, fd, filename, &bad);
+      close(fd);
+      if(mapped) {
+        return tr;
+      }
+      if(bad) {
+        free(tr);
+        return NULL;
+      }
+      gz = gzopen(filename, "rb");
+    }
+
+    if(gz == NULL) {
+      free(tr);
+      return NULL;
+    }
+    gzbuffer(gz, TRACE_READER_GZ_BUF);
+
+    tr->gz      = gz;
+    tr->dec_buf = (Trace_Rec *) calloc (TRACE_READER_BUF_RECS, sizeof (Trace_Rec));
+    tr->buf     = tr->dec_buf;
+
+    return tr;
+}
+
+void trace_close(Trace_Reader *tr){
+    if(tr == NULL) {
+      return;
+    }
+    if(tr->map) {
+      munmap(tr->map, tr->map_len);
+    }
+    if(tr->gz) {
+      gzclose((gzFile) tr->gz);
+    }
+    free(tr->dec_buf);
+    free(tr);
+}
+
+/**********************************************************************
+ * Decode the next block of records into the buffer. For gzip / raw
+ * input a trailing partial record is treated as end of trace, same as
+ * the old fread() loop.
+ **********************************************************************/
+
+static bool trace_refill_compact(Trace_Reader *tr){
+    tr->buf_pos = 0;
+    tr->buf_cnt = 0;
+    if(tr->blk_next >= tr->blk_end) {
+      tr->eof = true;
+      return false;
+    }
+
+    int32_t n = trace_compact_decode(tr->blk_next, tr->blk_end - tr->blk_next,
+                                     tr->dec_buf, TRACE_READER_BUF_RECS);
+    if(n < 0) {
+      fprintf(stderr, "Trace read error: corrupt compact block\n");
+      tr->eof = true;
+      return false;
+    }
+
+    Trace_Block_Hdr hdr;
+    memcpy(&hdr, tr->blk_next, sizeof(hdr));
+    tr->blk_next += hdr.block_bytes;
+    tr->buf_cnt = n;
+    return true;
+}
+
+bool trace_refill(Trace_Reader *tr){
+    if(tr->eof) {
+      return false;
+    }
+    if(tr->blk_next) {
+      return trace_refill_compact(tr);
+    }
+
+    int bytes_read = gzread((gzFile) tr->gz, tr->dec_buf,
+                            TRACE_READER_BUF_RECS * sizeof(Trace_Rec));
+    if(bytes_read < 0) {
+      int errnum;
+      fprintf(stderr, "Trace read error: %s\n", gzerror((gzFile) tr->gz, &errnum));
+      bytes_read = 0;
+    }
+
+    tr->buf_pos = 0;
+    tr->buf_cnt = bytes_read / sizeof(Trace_Rec);
+    if(bytes_read < (int)(TRACE_READER_BUF_RECS * sizeof(Trace_Rec))) {
+      tr->eof = true;
+    }
+
+    return tr->buf_cnt > 0;
+}
+
+/**********************************************************************
+ * Random access
+ **********************************************************************/
+
+// find the compact block holding rec; false if rec is past the end
+static bool trace_find_block(const Trace_Reader *tr, uint64_t rec,
+                             const uint8_t **blk, uint64_t *first_rec){
+    if(rec >= tr->num_recs) {
+      return false;
+    }
+
+    if(tr->index) {
+      uint64_t lo = 0, hi = tr->num_blocks;
+      while(hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if(tr->index[mid].first_rec <= rec) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      *blk = (const uint8_t *) tr->map + tr->index[lo].offset;
+      *first_rec = tr->index[lo].first_rec;
+      return true;
+    }
+
+    // version 1 traces have no index, hop over the block headers
+    const uint8_t *pos = tr->blk_first;
+    uint64_t first = 0;
+    while(pos + sizeof(Trace_Block_Hdr) <= tr->blk_end) {
+      Trace_Block_Hdr hdr;
+      memcpy(&hdr, pos, sizeof(hdr));
+      if(hdr.block_bytes == 0) {
+        break;
+      }
+      if(rec < first + hdr.num_recs) {
+        *blk = pos;
+        *first_rec = first;
+        return true;
+      }
+      first += hdr.num_recs;
+      pos += hdr.block_bytes;
+    }
+    return false;
+}
+
+bool trace_seek(Trace_Reader *tr, uint64_t rec){
+    // native: the whole trace is one buffer
+    if(tr->map && !tr->blk_first) {
+      if(rec > tr->num_recs) {
+        return false;
+      }
+      tr->buf_pos = rec;
+      tr->num_read = rec;
+      return true;
+    }
+
+    // compact: decode just the block holding rec
+    if(tr->blk_first) {
+      const uint8_t *blk;
+      uint64_t first_rec;
+      tr->buf_pos = 0;
+      tr->buf_cnt = 0;
+      if(!trace_find_block(tr, rec, &blk, &first_rec)) {
+        tr->blk_next = tr->blk_end;
+        tr->eof = true;
+        tr->num_read = tr->num_recs;
+        return rec == tr->num_recs;
+      }
+      tr->blk_next = blk;
+      tr->eof = false;
+      if(!trace_refill_compact(tr) || rec - first_rec >= tr->buf_cnt) {
+        return false;
+      }
+      tr->buf_pos = rec - first_rec;
+      tr->num_read = rec;
+      return true;
+    }
+
+    // gzip / raw: rewind if needed, then decode and discard
+    if(rec < tr->num_read) {
+      if(gzrewind((gzFile) tr->gz)) {
+        return false;
+      }
+      tr->buf_pos = 0;
+      tr->buf_cnt = 0;
+      tr->eof = false;
+      tr->num_read = 0;
+    }
+    while(tr->num_read < rec) {
+      if(tr->buf_pos == tr->buf_cnt && !trace_refill(tr)) {
+        return false;
+      }
+      uint64_t skip = tr->buf_cnt - tr->buf_pos;
+      if(skip > rec - tr->num_read) {
+        skip = rec - tr->num_read;
+      }
+      tr->buf_pos += skip;
+      tr->num_read += skip;
+    }
+    return true;
+}
+
+bool trace_slice(const Trace_Reader *tr, uint32_t k, uint32_t num_slices,
+                 uint64_t *begin, uint64_t *end){
+    if(!tr->map || num_slices == 0 || k >= num_slices) {
+      return false;
+    }
+
+    // native traces can be cut anywhere
+    if(!tr->blk_first) {
+      *begin = tr->num_recs * k / num_slices;
+      *end   = tr->num_recs * (k + 1) / num_slices;
+      return true;
+    }
+    if(!tr->index) {
+      return false;
+    }
+
+    uint64_t b0 = tr->num_blocks * k / num_slices;
+    uint64_t b1 = tr->num_blocks * (k + 1) / num_slices;
+    *begin = (b0 < tr->num_blocks) ? tr->index[b0].first_rec : tr->num_recs;
+    *end   = (b1 < tr->num_blocks) ? tr->index[b1].first_rec : tr->num_recs;
+    return true;
+}
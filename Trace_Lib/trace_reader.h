@@ -0,0 +1,77 @@
+#ifndef _TRACE_READER_H
+#define _TRACE_READER_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "trace_rec.h"
+#include "trace_format.h"
+
+/*********************************************************************
+* Trace Reader
+*
+* Streams Trace_Rec entries out of a trace file. gzip traces are
+* decoded in-process in large blocks, uncompressed traces are read
+* as-is, and a filename of "-" (or NULL) reads from stdin. Records are
+* handed out of an internal buffer, so the common path in trace_next()
+* is a pointer bump with no call into zlib or stdio.
+*
+* Native traces (see trace_format.h) are mmap'd read-only and buf
+* points straight into the mapping: nothing is decoded or copied, and
+* concurrent runs on the same trace share the page cache. Compact
+* traces are mmap'd too and decoded one block per refill.
+*
+* trace_seek() repositions the reader at any record: a pointer move for
+* native traces, one block decode for indexed compact traces, and a
+* decode-and-discard for gzip / raw input (which can only go backwards
+* by rewinding a regular file).
+**********************************************************************/
+
+#define TRACE_READER_BUF_RECS  8192        // records decoded per refill
+#define TRACE_READER_GZ_BUF    (1 << 18)   // zlib input buffer (bytes)
+
+typedef struct Trace_Reader_Struct {
+  void      *gz;                  // gzFile, kept opaque to avoid zlib.h here
+  const Trace_Rec *buf;           // records being handed out
+  Trace_Rec *dec_buf;             // decode buffer (gzip/raw input)
+  void      *map;                 // mapping (native / compact input)
+  size_t     map_len;
+  const uint8_t *blk_first;       // compact: first block
+  const uint8_t *blk_next;        // compact: next block to decode
+  const uint8_t *blk_end;
+  const Trace_Index_Entry *index; // compact v2: block index, else NULL
+  uint64_t   num_blocks;
+  uint64_t   num_recs;            // total records if known up front, else 0
+  uint64_t   buf_pos;             // next record to hand out
+  uint64_t   buf_cnt;             // valid records in buf
+  uint64_t   num_read;            // records handed out so far
+  bool       eof;                 // no more records after buf is drained
+}Trace_Reader;
+
+Trace_Reader* trace_open(const char *filename);   // NULL on failure
+void trace_close(Trace_Reader *tr);
+
+bool trace_refill(Trace_Reader *tr);              // false at end of trace
+
+/* Make record number rec (0-based) the next one trace_next() returns.
+ * Seeking to num_recs positions at end of trace. false if rec is past
+ * the end or the input cannot be repositioned. */
+bool trace_seek(Trace_Reader *tr, uint64_t rec);
+
+/* Bounds [*begin, *end) of slice k out of num_slices, cut on block
+ * boundaries so each slice can be decoded on its own. Needs a trace
+ * whose length is known up front (native / compact). */
+bool trace_slice(const Trace_Reader *tr, uint32_t k, uint32_t num_slices,
+                 uint64_t *begin, uint64_t *end);
+
+/* Returns the next record, or NULL at end of trace. The pointer stays
+ * valid until the following call. */
+static inline const Trace_Rec* trace_next(Trace_Reader *tr){
+    if(tr->buf_pos == tr->buf_cnt && !trace_refill(tr)) {
+      return NULL;
+    }
+    tr->num_read++;
+    return &tr->buf[tr->buf_pos++];
+}
+
+#endif
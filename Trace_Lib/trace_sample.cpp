@@ -0,0 +1,94 @@
+/***********************************************************************
+ * File         : trace_sample.cpp
+ * Description  : Window schedule and CPI estimator for sampled runs
+ **********************************************************************/
+
+#include "trace_sample.h"
+
+#include <math.h>
+
+/**********************************************************************
+ * Two-sided normal quantile for a confidence level, from Acklam's
+ * rational approximation (relative error under 1.2e-9)
+ **********************************************************************/
+
+static double normal_quantile(double p){
+    static const double a[] = {-3.969683028665376e+01,  2.209460984245205e+02,
+                               -2.759285104469687e+02,  1.383577518672690e+02,
+                               -3.066479806614716e+01,  2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01,  1.615858368580409e+02,
+                               -1.556989798598866e+02,  6.680131188771972e+01,
+                               -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                               -2.400758277161838e+00, -2.549732539343734e+00,
+                                4.374664141464968e+00,  2.938163982698783e+00};
+    static const double d[] = { 7.784695709041462e-03,  3.224671290700398e-01,
+                                2.445134137142996e+00,  3.754408661907416e+00};
+
+    if(p < 0.02425) {
+      double q = sqrt(-2 * log(p));
+      return (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) /
+             ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+    }
+    if(p > 1 - 0.02425) {
+      return -normal_quantile(1 - p);
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q /
+           (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+}
+
+void trace_sampler_init(Trace_Sampler *s, uint64_t unit, uint64_t warm, uint64_t period,
+                        uint64_t num_recs, double target, double confidence){
+    s->unit = unit ? unit : 1;
+    s->warm = warm;
+    if(period == 0) {
+      period = num_recs ? num_recs / TRACE_SAMPLE_MIN : 100 * (s->unit + s->warm);
+    }
+    s->period = (period < s->unit + s->warm) ? s->unit + s->warm : period;
+    s->target = target;
+    s->z = normal_quantile(0.5 + confidence / 2);
+    s->min_samples = TRACE_SAMPLE_MIN;
+
+    s->pass = 0;
+    s->step = s->period;
+    s->next = 0;
+
+    s->n = 0;
+    s->mean = 0;
+    s->m2 = 0;
+}
+
+void trace_sampler_add(Trace_Sampler *s, double cpi){
+    s->n++;
+    double delta = cpi - s->mean;
+    s->mean += delta / s->n;
+    s->m2 += delta * (cpi - s->mean);
+
+    s->next += s->step;
+}
+
+bool trace_sampler_next_pass(Trace_Sampler *s){
+    // pass 1 splits the pass 0 gaps, each later pass halves the step
+    uint64_t step = (s->pass == 0) ? s->period : s->step / 2;
+    if(step / 2 < s->unit + s->warm) {
+      return false;
+    }
+    s->pass++;
+    s->step = step;
+    s->next = step / 2;
+    return true;
+}
+
+double trace_sampler_error(const Trace_Sampler *s){
+    if(s->n < 2 || s->mean <= 0) {
+      return HUGE_VAL;
+    }
+    double stddev = sqrt(s->m2 / (s->n - 1));
+    return s->z * stddev / sqrt((double)s->n) / s->mean;
+}
+
+bool trace_sampler_done(const Trace_Sampler *s){
+    return s->n >= s->min_samples && trace_sampler_error(s) <= s->target;
+}
@@ -0,0 +1,63 @@
+#ifndef _TRACE_SAMPLE_H
+#define _TRACE_SAMPLE_H
+
+#include <inttypes.h>
+
+/*********************************************************************
+* Statistical Sampling (SMARTS)
+*
+* The trace is measured in short windows of unit instructions, each
+* preceded by warm instructions of unmeasured detailed simulation and
+* reached by functional fast-forward. Every window contributes one CPI
+* sample; because the windows are the same length the mean of their
+* CPIs estimates the CPI of the whole trace, with a confidence interval
+* from the sample variance.
+*
+* Windows are laid out in passes over the whole trace so the sample is
+* never biased toward its start: pass 0 puts one window every period
+* instructions, and each later pass puts one halfway between every two
+* windows already taken. The run stops at the end of any window once
+* there are at least min_samples and the interval is within target of
+* the mean; otherwise the caller rewinds and starts the next pass.
+**********************************************************************/
+
+#define TRACE_SAMPLE_UNIT        1000    // default measured insts per window
+#define TRACE_SAMPLE_WARM        200     // default detailed warmup per window
+#define TRACE_SAMPLE_MIN         30      // samples before the interval is trusted
+#define TRACE_SAMPLE_TARGET      0.01    // default relative error
+#define TRACE_SAMPLE_CONFIDENCE  0.99    // default confidence level
+
+typedef struct Trace_Sampler_Struct {
+  uint64_t unit;                         // measured insts per window
+  uint64_t warm;                         // detailed warmup insts per window
+  uint64_t period;                       // window spacing in pass 0
+  double   target;                       // stop at this relative half-width
+  double   z;                            // normal quantile for the confidence
+  uint32_t min_samples;
+
+  uint32_t pass;
+  uint64_t step;                         // window spacing in this pass
+  uint64_t next;                         // start of the next window
+
+  uint64_t n;                            // CPI samples (Welford)
+  double   mean;
+  double   m2;
+}Trace_Sampler;
+
+/* period 0 picks one that gives min_samples windows over num_recs
+ * records (or 100 windows' worth of spacing if num_recs is unknown) */
+void trace_sampler_init(Trace_Sampler *s, uint64_t unit, uint64_t warm, uint64_t period,
+                        uint64_t num_recs, double target, double confidence);
+
+/* Record the CPI of the window at s->next and move to the next one */
+void trace_sampler_add(Trace_Sampler *s, double cpi);
+
+/* The current pass ran off the end of the trace. Moves to the next,
+ * denser pass; false if windows would overlap, i.e. the sample cannot
+ * grow any further. */
+bool trace_sampler_next_pass(Trace_Sampler *s);
+
+double trace_sampler_error(const Trace_Sampler *s);   // relative half-width
+bool trace_sampler_done(const Trace_Sampler *s);      // target reached
+
+#endif
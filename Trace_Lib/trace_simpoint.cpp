@@ -0,0 +1,106 @@
+/***********************************************************************
+ * File         : trace_simpoint.cpp
+ * Description  : Read / write simulation point files
+ **********************************************************************/
+
+#include "trace_simpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static bool simpoint_before(const Trace_Simpoint &a, const Trace_Simpoint &b){
+    return a.interval < b.interval;
+}
+
+Trace_Simpoint_Set* trace_simpoints_read(const char *filename){
+    FILE *file = fopen(filename, "r");
+    if(file == NULL) {
+      perror(filename);
+      return NULL;
+    }
+
+    Trace_Simpoint_Set *sp = (Trace_Simpoint_Set *) calloc (1, sizeof (Trace_Simpoint_Set));
+    uint32_t cap = 0;
+    double weight_sum = 0;
+    const char *why = NULL;
+    char line[256];
+    uint32_t line_num = 0;
+
+    while(why == NULL && fgets(line, sizeof(line), file)) {
+      line_num++;
+      char *pos = line + strspn(line, " \t");
+      if(*pos == '#' || *pos == '\n' || *pos == '\0') {
+        continue;
+      }
+
+      unsigned long long num;
+      double weight;
+      if(sscanf(pos, "interval %llu", &num) == 1) {
+        sp->interval_len = num;
+      } else if(sscanf(pos, "%llu %lf", &num, &weight) == 2 && weight > 0) {
+        if(sp->num_points == cap) {
+          cap = cap ? 2 * cap : 16;
+          sp->points = (Trace_Simpoint *) realloc (sp->points, cap * sizeof (Trace_Simpoint));
+        }
+        Trace_Simpoint *pt = &sp->points[sp->num_points];
+        pt->interval = num;
+        pt->weight   = weight;
+        sp->num_points++;
+        weight_sum += weight;
+      } else {
+        fprintf(stderr, "%s:%u: unrecognized line\n", filename, line_num);
+        why = "malformed simpoint file";
+      }
+    }
+    fclose(file);
+
+    if(why == NULL && sp->interval_len == 0) {
+      why = "no interval length";
+    } else if(why == NULL && sp->num_points == 0) {
+      why = "no simulation points";
+    }
+    std::sort(sp->points, sp->points + sp->num_points, simpoint_before);
+    for(uint32_t ii = 1; why == NULL && ii < sp->num_points; ii++) {
+      if(sp->points[ii].interval == sp->points[ii - 1].interval) {
+        why = "interval listed twice";
+      }
+    }
+    if(why) {
+      fprintf(stderr, "%s: %s\n", filename, why);
+      trace_simpoints_free(sp);
+      return NULL;
+    }
+
+    for(uint32_t ii = 0; ii < sp->num_points; ii++) {
+      sp->points[ii].weight /= weight_sum;
+    }
+    return sp;
+}
+
+bool trace_simpoints_write(const char *filename, const Trace_Simpoint_Set *sp,
+                           const char *comment){
+    FILE *file = fopen(filename, "w");
+    if(file == NULL) {
+      perror(filename);
+      return false;
+    }
+
+    if(comment) {
+      fprintf(file, "# %s\n", comment);
+    }
+    fprintf(file, "interval %" PRIu64 "\n", sp->interval_len);
+    for(uint32_t ii = 0; ii < sp->num_points; ii++) {
+      fprintf(file, "%" PRIu64 " %.6f\n", sp->points[ii].interval, sp->points[ii].weight);
+    }
+    return fclose(file) == 0;
+}
+
+void trace_simpoints_free(Trace_Simpoint_Set *sp){
+    if(sp == NULL) {
+      return;
+    }
+    free(sp->points);
+    free(sp);
+}
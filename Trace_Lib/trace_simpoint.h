@@ -0,0 +1,42 @@
+#ifndef _TRACE_SIMPOINT_H
+#define _TRACE_SIMPOINT_H
+
+#include <inttypes.h>
+
+/*********************************************************************
+* Simulation Points
+*
+* A simpoint file names the fixed-length intervals of a trace that
+* stand in for the whole run, each with the fraction of the run it
+* represents. trace_profile writes one; sim and procsim simulate only
+* the listed intervals and weight their CPI by it. The file is text:
+*
+*   # any comment
+*   interval <instructions per interval>
+*   <interval number> <weight>
+*   ...
+*
+* Interval n covers trace records [n * interval, (n + 1) * interval).
+**********************************************************************/
+
+typedef struct Trace_Simpoint_Struct {
+  uint64_t interval;                     // interval number
+  double   weight;                       // fraction of the run, sums to 1
+}Trace_Simpoint;
+
+typedef struct Trace_Simpoint_Set_Struct {
+  uint64_t interval_len;                 // records per interval
+  uint32_t num_points;
+  Trace_Simpoint *points;                // sorted by interval
+}Trace_Simpoint_Set;
+
+/* NULL (with a message on stderr) if the file is missing or malformed.
+ * Weights are renormalized to sum to 1. */
+Trace_Simpoint_Set* trace_simpoints_read(const char *filename);
+
+bool trace_simpoints_write(const char *filename, const Trace_Simpoint_Set *sp,
+                           const char *comment);
+
+void trace_simpoints_free(Trace_Simpoint_Set *sp);
+
+#endif
@@ -0,0 +1,88 @@
+/***********************************************************************
+ * File         : trace_split.cpp
+ * Description  : Cut a trace into K independent slices
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_reader.h"
+#include "trace_writer.h"
+
+void die_usage() {
+    printf("Usage : trace_split [options] <in_trace> <out_prefix>\n\n");
+    printf("Cuts a native or compact trace into slices <out_prefix>.0 .. .K-1.\n");
+    printf("Compact traces are cut on block boundaries.\n");
+    printf("Options\n");
+    printf("   -k <num>     Number of slices (Default: 2)\n");
+    printf("   -native      Write native slices\n");
+    printf("   -compact     Write compact slices (Default)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    Trace_Format format = TRACE_FMT_COMPACT;
+    uint32_t num_slices = 2;
+    const char *in_name = NULL;
+    const char *out_prefix = NULL;
+
+    for(int ii = 1; ii < argc; ii++) {
+      if(!strcmp(argv[ii], "-k") && ii < argc - 1) {
+        num_slices = atoi(argv[++ii]);
+      } else if(!strcmp(argv[ii], "-native")) {
+        format = TRACE_FMT_NATIVE;
+      } else if(!strcmp(argv[ii], "-compact")) {
+        format = TRACE_FMT_COMPACT;
+      } else if(argv[ii][0] == '-') {
+        die_usage();
+      } else if(in_name == NULL) {
+        in_name = argv[ii];
+      } else if(out_prefix == NULL) {
+        out_prefix = argv[ii];
+      } else {
+        die_usage();
+      }
+    }
+    if(out_prefix == NULL || num_slices == 0) {
+      die_usage();
+    }
+
+    Trace_Reader *tr = trace_open(in_name);
+    if(tr == NULL) {
+      printf("Error! Unable to open the trace file %s. Exiting...\n", in_name);
+      exit(1);
+    }
+
+    for(uint32_t k = 0; k < num_slices; k++) {
+      uint64_t begin, end;
+      if(!trace_slice(tr, k, num_slices, &begin, &end)) {
+        printf("Error! %s cannot be sliced, convert it with trace_convert first. Exiting...\n", in_name);
+        exit(1);
+      }
+
+      char out_name[1024];
+      snprintf(out_name, sizeof(out_name), "%s.%u", out_prefix, k);
+      Trace_Writer *tw = trace_writer_open(out_name, format);
+      if(tw == NULL) {
+        printf("Error! Unable to create %s. Exiting...\n", out_name);
+        exit(1);
+      }
+
+      bool ok = trace_seek(tr, begin);
+      for(uint64_t rec = begin; ok && rec < end; rec++) {
+        const Trace_Rec *tr_entry = trace_next(tr);
+        ok = (tr_entry != NULL) && trace_write(tw, tr_entry, 1);
+      }
+      ok = trace_writer_close(tw) && ok;
+      if(!ok) {
+        printf("Error! Write to %s failed. Exiting...\n", out_name);
+        exit(1);
+      }
+      printf("%s: records %" PRIu64 " .. %" PRIu64 "\n", out_name, begin, end);
+    }
+
+    trace_close(tr);
+    return 0;
+}
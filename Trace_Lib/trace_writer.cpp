@@ -0,0 +1,149 @@
+/***********************************************************************
+ * File         : trace_writer.cpp
+ * Description  : Writer for the native and compact trace formats
+ **********************************************************************/
+
+#include "trace_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_WRITER_FILE_BUF (1 << 20)
+
+/**********************************************************************
+ * All headers are 64 bytes; write whichever one format calls for
+ **********************************************************************/
+
+static bool trace_write_hdr(Trace_Writer *tw){
+    if(tw->format == TRACE_FMT_BRANCH) {
+      Trace_Branch_Hdr hdr;
+      trace_branch_hdr_init(&hdr);
+      hdr.num_recs  = tw->num_recs;
+      hdr.num_insts = tw->num_insts;
+      return fwrite(&hdr, sizeof(hdr), 1, tw->file) == 1;
+    }
+    if(tw->format == TRACE_FMT_COMPACT) {
+      Trace_Compact_Hdr hdr;
+      trace_compact_hdr_init(&hdr);
+      hdr.num_recs     = tw->num_recs;
+      hdr.num_blocks   = tw->num_blocks;
+      hdr.index_offset = tw->index_offset;
+      return fwrite(&hdr, sizeof(hdr), 1, tw->file) == 1;
+    }
+
+    Trace_Native_Hdr hdr;
+    trace_native_hdr_init(&hdr);
+    hdr.num_recs = tw->num_recs;
+    return fwrite(&hdr, sizeof(hdr), 1, tw->file) == 1;
+}
+
+static bool trace_flush_block(Trace_Writer *tw){
+    if(tw->block_cnt == 0) {
+      return true;
+    }
+
+    uint32_t bytes = trace_compact_encode(tw->block, tw->block_cnt, tw->enc_buf);
+    if(bytes == 0) {
+      tw->bad_rec = true;
+      return false;
+    }
+    if(fwrite(tw->enc_buf, 1, bytes, tw->file) != bytes) {
+      return false;
+    }
+
+    if(tw->num_blocks == tw->index_cap) {
+      tw->index_cap = tw->index_cap ? 2 * tw->index_cap : 256;
+      tw->index = (Trace_Index_Entry *) realloc (tw->index, tw->index_cap * sizeof (Trace_Index_Entry));
+    }
+    tw->index[tw->num_blocks].offset    = tw->num_bytes;
+    tw->index[tw->num_blocks].first_rec = tw->num_recs;
+
+    tw->num_bytes += bytes;
+    tw->num_recs += tw->block_cnt;
+    tw->num_blocks++;
+    tw->block_cnt = 0;
+    return true;
+}
+
+Trace_Writer* trace_writer_open(const char *filename, Trace_Format format){
+    FILE *file = fopen(filename, "wb");
+    if(file == NULL) {
+      return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, TRACE_WRITER_FILE_BUF);
+
+    Trace_Writer *tw = (Trace_Writer *) calloc (1, sizeof (Trace_Writer));
+    tw->file = file;
+    tw->format = format;
+    if(format == TRACE_FMT_COMPACT) {
+      tw->block   = (Trace_Rec *) malloc (TRACE_COMPACT_BLOCK_RECS * sizeof (Trace_Rec));
+      tw->enc_buf = (uint8_t *) malloc (TRACE_COMPACT_MAX_BYTES(TRACE_COMPACT_BLOCK_RECS));
+    }
+
+    // placeholder header, the counts are patched in on close
+    if(!trace_write_hdr(tw)) {
+      fclose(file);
+      free(tw);
+      return NULL;
+    }
+    tw->num_bytes = ftell(file);
+    return tw;
+}
+
+bool trace_write(Trace_Writer *tw, const Trace_Rec *recs, uint64_t count){
+    if(tw->format == TRACE_FMT_BRANCH) {
+      for(uint64_t ii = 0; ii < count; ii++) {
+        if(recs[ii].op_type != OP_CBR) {
+          continue;
+        }
+        Trace_Branch_Rec br;
+        memset(&br, 0, sizeof(br));
+        br.pc  = recs[ii].inst_addr;
+        br.dir = recs[ii].br_dir;
+        if(fwrite(&br, sizeof(br), 1, tw->file) != 1) {
+          return false;
+        }
+        tw->num_recs++;
+      }
+      tw->num_insts += count;
+      return true;
+    }
+
+    if(tw->format == TRACE_FMT_NATIVE) {
+      if(fwrite(recs, sizeof(Trace_Rec), count, tw->file) != count) {
+        return false;
+      }
+      tw->num_recs += count;
+      return true;
+    }
+
+    for(uint64_t ii = 0; ii < count; ii++) {
+      tw->block[tw->block_cnt++] = recs[ii];
+      if(tw->block_cnt == TRACE_COMPACT_BLOCK_RECS && !trace_flush_block(tw)) {
+        return false;
+      }
+    }
+    return true;
+}
+
+static bool trace_write_index(Trace_Writer *tw){
+    if(!trace_flush_block(tw)) {
+      return false;
+    }
+    tw->index_offset = tw->num_bytes;
+    return fwrite(tw->index, sizeof(Trace_Index_Entry), tw->num_blocks, tw->file) == tw->num_blocks;
+}
+
+bool trace_writer_close(Trace_Writer *tw){
+    bool ok = (tw->format != TRACE_FMT_COMPACT || trace_write_index(tw))
+           && !ferror(tw->file)
+           && fseek(tw->file, 0, SEEK_SET) == 0
+           && trace_write_hdr(tw);
+    ok = (fclose(tw->file) == 0) && ok;
+
+    free(tw->block);
+    free(tw->enc_buf);
+    free(tw->index);
+    free(tw);
+    return ok;
+}
@@ -0,0 +1,46 @@
+#ifndef _TRACE_WRITER_H
+#define _TRACE_WRITER_H
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "trace_rec.h"
+#include "trace_format.h"
+
+/*********************************************************************
+* Trace Writer
+*
+* Writes a native, compact or branch trace (see trace_format.h). The
+* header is written up front and patched on close, so the output must
+* be a regular, seekable file. Compact traces get their block index
+* appended on close; branch traces keep only the OP_CBR records.
+**********************************************************************/
+
+typedef enum Trace_Format_Enum {
+    TRACE_FMT_NATIVE,
+    TRACE_FMT_COMPACT,
+    TRACE_FMT_BRANCH,
+    NUM_TRACE_FMT
+} Trace_Format;
+
+typedef struct Trace_Writer_Struct {
+  FILE        *file;
+  Trace_Format format;
+  uint64_t     num_recs;          // records written so far
+  uint64_t     num_insts;         // branch: records passed to trace_write
+  uint64_t     num_blocks;        // compact blocks written so far
+  uint64_t     num_bytes;         // compact: file offset of the next block
+  Trace_Index_Entry *index;       // compact: one entry per block written
+  uint64_t     index_cap;
+  uint64_t     index_offset;      // compact: where the index went, on close
+  Trace_Rec   *block;             // compact: records waiting to be encoded
+  uint32_t     block_cnt;
+  uint8_t     *enc_buf;           // compact: encoded block
+  bool         bad_rec;           // a record could not be compact-encoded
+}Trace_Writer;
+
+Trace_Writer* trace_writer_open(const char *filename, Trace_Format format);   // NULL on failure
+bool trace_write(Trace_Writer *tw, const Trace_Rec *recs, uint64_t count);
+bool trace_writer_close(Trace_Writer *tw);              // false if any write failed
+
+#endif